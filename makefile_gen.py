@@ -21,31 +21,37 @@ sources = [
     "stan/src/stan/lang/grammars/term_grammar_inst.cpp",
     "stan/src/stan/lang/grammars/var_decls_grammar_inst.cpp",
     "stan/src/stan/lang/grammars/whitespace_grammar_inst.cpp",
+    "stan2pyro/libstan2pyro.cpp",
     "stan2pyro/stan2pyro.cpp"
 ]
 import copy
 deps = copy.deepcopy(sources)
-deps[-1] = "stan2pyro/stan2pyro.cpp stan2pyro/gen_pyro_expression.hpp stan2pyro/gen_pyro_statement.hpp"
+deps[-2] = "stan2pyro/libstan2pyro.cpp stan2pyro/stan2pyro.h stan2pyro/pyro_compiler.hpp stan2pyro/pyro_compile_cache.hpp stan2pyro/gen_pyro_context.hpp stan2pyro/gen_pyro_symbols.hpp stan2pyro/gen_pyro_ir.hpp stan2pyro/gen_pyro_lower.hpp stan2pyro/gen_pyro_fold.hpp stan2pyro/gen_pyro_printer.hpp stan2pyro/gen_pyro_vectorize.hpp stan2pyro/gen_pyro_cse.hpp stan2pyro/gen_pyro_licm.hpp stan2pyro/gen_pyro_dce.hpp stan2pyro/gen_pyro_shapes.hpp stan2pyro/gen_pyro_zero_based.hpp stan2pyro/gen_pyro_bounds.hpp stan2pyro/gen_pyro_target.hpp stan2pyro/gen_pyro_enumerate.hpp stan2pyro/gen_pyro_functions.hpp stan2pyro/gen_pyro_distributions.hpp"
+deps[-1] = "stan2pyro/stan2pyro.cpp stan2pyro/pyro_compiler.hpp stan2pyro/pyro_compile_cache.hpp"
 BUILD = "stan2pyro/build/"
 names = list(map(lambda x: BUILD + ((x.split("/")[-1]).split(".")[0]) + ".o", sources))
+lib_names = names[:-1] # everything but the command line driver
 
 BIN = "stan2pyro/bin/"
 
 
 
-print("CMD=g++ %s -D FUSION_MAX_VECTOR_SIZE=12 -DBOOST_RESULT_OF_USE_TR1 -DBOOST_NO_DECLTYPE -DBOOST_DISABLE_ASSERTS -Os -ftemplate-depth-256 -Wno-unused-function -Wno-uninitialized -I stan/src -I stan/lib/stan_math/ -I stan/lib/stan_math/lib/eigen_3.3.3 -I stan/lib/stan_math/lib/boost_1.65.1 -I stan/lib/stan_math/lib/cvodes_2.9.0/include -I stan2pyro\n" % (DBG_OPTS))
+print("CMD=g++ %s -std=c++11 -pthread -fPIC -D FUSION_MAX_VECTOR_SIZE=12 -DBOOST_RESULT_OF_USE_TR1 -DBOOST_NO_DECLTYPE -DBOOST_DISABLE_ASSERTS -Os -ftemplate-depth-256 -Wno-unused-function -Wno-uninitialized -I stan/src -I stan/lib/stan_math/ -I stan/lib/stan_math/lib/eigen_3.3.3 -I stan/lib/stan_math/lib/boost_1.65.1 -I stan/lib/stan_math/lib/cvodes_2.9.0/include -I stan2pyro\n" % (DBG_OPTS))
 
 
-print("\nall: %sstan2pyro" % BIN)
+print("\nall: %sstan2pyro %slibstan2pyro.so" % (BIN, BIN))
 
 print("\nclean:")
 print("\t-rm -rf %s %s" % (BIN,BUILD)) 
 
-print("\n%sstan2pyro: %s %s" % (BIN, " ".join(names),BUILD))
-print("\t$(CMD) -o %sstan2pyro %s*.o" % (BIN,BUILD))
+print("\n%sstan2pyro: %s" % (BIN, " ".join(names)))
+print("\t$(CMD) -o %sstan2pyro %s" % (BIN, " ".join(names)))
 
-print("\nexe: %sstan2pyro.o" % BUILD) 
-print("\t$(CMD) -o %sstan2pyro %s*.o" % (BIN, BUILD)) 
+print("\n%slibstan2pyro.so: %s" % (BIN, " ".join(lib_names)))
+print("\t$(CMD) -shared -o %slibstan2pyro.so %s" % (BIN, " ".join(lib_names)))
+
+print("\nexe: %sstan2pyro.o %slibstan2pyro.o" % (BUILD, BUILD))
+print("\t$(CMD) -o %sstan2pyro %s" % (BIN, " ".join(names)))
 
 for i in range(len(names)):
     print("\n%s: %s" % (names[i], deps[i]))
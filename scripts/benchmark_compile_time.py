@@ -0,0 +1,106 @@
+import os
+import sys
+import math
+import time
+import collections
+import tempfile
+import subprocess
+
+STAN2PYRO = "../stan2pyro/bin/stan2pyro"
+
+
+def synthetic_model(n_stmts):
+    """
+    Hierarchical-looking Stan model with n_stmts sampling statements in the model block
+    (every statement is nested inside a loop so that nested visitors are exercised too)
+    """
+    lines = ["data {", "  int N;", "  real y[N];", "}", "parameters {"]
+    for i in range(n_stmts):
+        lines.append("  real mu_%d;" % i)
+    lines += ["  real<lower=0> sigma;", "}", "model {", "  sigma ~ cauchy(0, 5);"]
+    for i in range(n_stmts):
+        lines.append("  mu_%d ~ normal(0, 10);" % i)
+        lines.append("  for (n in 1:N) {")
+        lines.append("    y[n] ~ normal(mu_%d, sigma);" % i)
+        lines.append("  }")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+def time_compile(mfile, n_repeats):
+    best = None
+    for _ in range(n_repeats):
+        start = time.time()
+        process = subprocess.Popen([STAN2PYRO, mfile], stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        _, err = process.communicate()
+        elapsed = time.time() - start
+        assert process.returncode == 0, "stan2pyro failed on %s: %s" % (mfile, err.decode('utf-8'))
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+def phase_timings(mfile):
+    """
+    Run stan2pyro --phase-timings on one file and return {phase: ms}, or None if it failed
+    """
+    process = subprocess.Popen([STAN2PYRO, "--phase-timings", mfile], stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    _, err = process.communicate()
+    if process.returncode != 0:
+        return None
+    timings = {}
+    lines = err.decode('utf-8').splitlines()
+    start = lines.index("# phase timings (ms)")
+    for line in lines[start + 1:]:
+        phase, ms = line.rsplit(None, 1)
+        timings[phase] = float(ms)
+    return timings
+
+
+def corpus_phase_timings(root):
+    totals = collections.OrderedDict()
+    n_ok, n_failed = 0, 0
+    for path, _, files in os.walk(root):
+        for name in sorted(files):
+            if not name.endswith(".stan"):
+                continue
+            timings = phase_timings(os.path.join(path, name))
+            if timings is None:
+                n_failed += 1
+                continue
+            n_ok += 1
+            for phase in timings:
+                totals[phase] = totals.get(phase, 0.) + timings[phase]
+    print("%d files compiled, %d failed" % (n_ok, n_failed))
+    for phase in totals:
+        print("%16s %12.1f ms" % (phase, totals[phase]))
+
+
+if __name__ == "__main__":
+    import argparse
+    parser = argparse.ArgumentParser(description="Measure stan2pyro compile time against model size")
+    parser.add_argument('-s', '--sizes', nargs='+', type=int, default=[50, 100, 200, 400, 800, 1600],
+                        help="number of sampling statements per synthetic model")
+    parser.add_argument('-r', '--repeats', default=3, type=int, help="runs per size (best is reported)")
+    parser.add_argument('-c', '--corpus', default=None, type=str,
+                        help="instead of synthetic models, sum per-phase timings over every .stan file in this folder")
+    args = parser.parse_args()
+
+    if args.corpus is not None:
+        corpus_phase_timings(args.corpus)
+        sys.exit(0)
+
+    tmp_dir = tempfile.mkdtemp(prefix="stan2pyro_bench_")
+    results = []
+    for n in args.sizes:
+        mfile = os.path.join(tmp_dir, "synthetic_%d.stan" % n)
+        with open(mfile, "w") as f:
+            f.write(synthetic_model(n))
+        results.append((n, time_compile(mfile, args.repeats)))
+
+    print("%10s %12s %16s" % ("stmts", "seconds", "ms / stmt"))
+    for (n, t) in results:
+        print("%10d %12.3f %16.4f" % (n, t, 1000. * t / n))
+    # compile time is linear when ms / stmt stays flat; quadratic growth doubles it with every row
+    (n0, t0), (n1, t1) = results[0], results[-1]
+    if len(results) > 1 and t0 > 0:
+        print("growth exponent ~ %.2f (1.0 = linear)" % (math.log(t1 / t0) / math.log(float(n1) / n0)))
@@ -43,7 +43,10 @@ def run_pyro_nuts(data, pfile, n_samples, params):
     if transformed_data is not None:
         transformed_data(data)
 
-    nuts_kernel = NUTS(model, step_size=0.0855)
+    # modules with enumerated latent variables set max_plate_nesting,
+    # which NUTS needs to marginalize them out
+    max_plate_nesting = getattr(__import__(pfile, fromlist=['']), "max_plate_nesting", None)
+    nuts_kernel = NUTS(model, step_size=0.0855, max_plate_nesting=max_plate_nesting)
     mcmc_run = MCMC(nuts_kernel, num_samples=n_samples, warmup_steps=int(n_samples/2))
     posteriors = {k: [] for k in params}
 
@@ -6,6 +6,7 @@ import pystan
 import sys
 import numpy as np
 import pyro.poutine as poutine
+from pyro.infer import TraceEnum_ELBO
 from pdb import set_trace as bb
 import copy
 #TODO: init_values is a dictionary mapping variable name to values/floats
@@ -47,7 +48,7 @@ def get_num_log_probs(trace):
     assert n > 0
     return n
 
-def run_pyro(site_values, data, model, transformed_data, n_samples, params):
+def run_pyro(site_values, data, model, transformed_data, n_samples, params, max_plate_nesting=None):
 
     # import model, transformed_data functions (if exists) from pyro module
 
@@ -68,9 +69,15 @@ def run_pyro(site_values, data, model, transformed_data, n_samples, params):
 
         variablize_params(sample_site_values)
 
-        model_trace = poutine.trace(poutine.condition(model, data=sample_site_values),
-                                    graph_type="flat").get_trace(data, params)
-        log_p = model_trace.log_pdf()
+        conditioned_model = poutine.condition(model, data=sample_site_values)
+        model_trace = poutine.trace(conditioned_model, graph_type="flat").get_trace(data, params)
+        if max_plate_nesting is None:
+            log_p = model_trace.log_pdf()
+        else:
+            # sum out the enumerated discrete latent variables, as Stan's log_sum_exp does;
+            # every other site is conditioned, so the guide is empty
+            elbo = TraceEnum_ELBO(max_plate_nesting=max_plate_nesting)
+            log_p = -elbo.differentiable_loss(conditioned_model, lambda *args: None, data, params)
         if n_log_probs is None:
             n_log_probs = get_num_log_probs(model_trace)
         else:
@@ -129,7 +136,8 @@ def process_2d_sites(svs):
     for k in n_svs:
         svs[k] = n_svs[k]
 
-def compare_models(code, data, init_params, model, transformed_data, n_runs=2, model_cache=None):
+def compare_models(code, data, init_params, model, transformed_data, n_runs=2, model_cache=None,
+                   max_plate_nesting=None):
 
     copy_data = copy.deepcopy(data)
     tensorize_data(data)
@@ -161,7 +169,8 @@ def compare_models(code, data, init_params, model, transformed_data, n_runs=2, m
 
 
         try:
-            p_log_probs, n_log_probs = run_pyro(site_values, data, model, transformed_data, n_samples=1, params=params)
+            p_log_probs, n_log_probs = run_pyro(site_values, data, model, transformed_data, n_samples=1, params=params,
+                                                max_plate_nesting=max_plate_nesting)
         except (RuntimeError, NotImplementedError, AssertionError, RuntimeError, NameError) as e:
             return handle_error("run_pyro", e)
 
@@ -4,6 +4,7 @@ from utils import mkdir_p
 from divide_stan_data import divide_data
 from pdb import set_trace as bb
 from test_compare_models import test_generic, cache_all_models
+from utils import generate_pyro_files
 
 def get_all_data_paths(root, ofldr):
     args = []
@@ -58,6 +59,8 @@ if __name__ == "__main__":
     parser = argparse.ArgumentParser()
     parser.add_argument('-e', '--examples-folder', required=True, type=str, help="Examples Stan folder")
     parser.add_argument('-i', '--eid', default=None, type=int, help="example id to run")
+    parser.add_argument('-c', '--cache-dir', default='./test_compiler/stan2pyro_cache', type=str,
+                        help="stan2pyro compile cache (unchanged models are not recompiled)")
     p_args = parser.parse_args()
     ofldr = './test_compiler'
     mkdir_p(ofldr)
@@ -90,12 +93,14 @@ if __name__ == "__main__":
                 status[k] = []
 
     cache_all_models(args)
+    compile_errors = generate_pyro_files([(mfile, pfile) for (dfile, mfile, pfile, model_cache) in args],
+                                         cache_dir=p_args.cache_dir)
     #bb()
 
     for (dfile,mfile,pfile,model_cache) in args:
         n_runs = 2
         print("STARTING TO PROCESS %d: pyro-file: %s" % (j, pfile))
-        this_try, err = test_generic(dfile,mfile,pfile,n_runs,model_cache)
+        this_try, err = test_generic(dfile,mfile,pfile,n_runs,model_cache,compile_errors)
         #if err is not None and "const" in err and "Assertion" in err and "false" in err:
         #    bb()
         status[this_try].append((dfile,mfile,pfile,model_cache,err))
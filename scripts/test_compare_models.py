@@ -3,7 +3,8 @@ from compare_models import compare_models
 from utils import  EPSILON, set_seed, to_variable, to_float, get_fns_pyro, \
     fma, init_real, do_pyro_compatibility_hacks, generate_pyro_file, handle_error, \
     mkdir_p, load_data, json_file_to_mem_format, _pyro_sample, _call_func, log_traceback, \
-    init_vector, init_matrix, to_int, _pyro_assign, _index_select
+    init_vector, init_matrix, to_int, _pyro_assign, _index_select, Stan2PyroLibrary, \
+    sanitize_module_loading_file
 import pyro
 import pyro.distributions as dist
 import torch
@@ -155,6 +156,244 @@ def test4():
     print(m, e)
     assert m == 0, "test not successful"
 
+def compare_generated(n, code, data, lib=None):
+    # compile code with stan2pyro, in-process when lib is given, and compare the result with Stan
+    model_cache = "./test/model_%d.stan.pkl" % n
+    mfile = "./test/model_%d.stan" % n
+    pfile = "./test/model_%d_autogen.py" % n
+    with open(mfile, "w") as f:
+        f.write(code)
+    generate_pyro_file(mfile, pfile, lib=lib)
+    validate_data_def, init_params, model, transformed_data = get_fns_pyro(pfile)
+    data = json_file_to_mem_format(data)
+    validate_data_def(data)
+    # set by modules with enumerated discrete latent variables
+    max_plate_nesting = getattr(__import__(sanitize_module_loading_file(pfile), fromlist=['']),
+                                "max_plate_nesting", None)
+    return compare_models(code, data, init_params, model, transformed_data, n_runs=2,
+                          model_cache=model_cache, max_plate_nesting=max_plate_nesting)
+
+def test6():
+    # locals sized by the loop variable (ragged arrays) keep the loop 1-based
+    code = """
+    data {
+      int N;
+      int J;
+      vector[N] y;
+      int pos[J];
+      int len[J];
+    }
+    parameters {
+      real mu[J];
+    }
+    model {
+      mu ~ normal(0, 10);
+      for (j in 1:J) {
+        vector[len[j]] v;
+        v = segment(y, pos[j], len[j]);
+        v ~ normal(mu[j], 1);
+      }
+    }
+    """
+    m, e = compare_generated(6, code, {"N": 5, "J": 2, "y": [0.1, -0.4, 1.2, 0.3, 0.8],
+                                       "pos": [1, 3], "len": [2, 3]})
+    print(m, e)
+    assert m == 0, "test not successful"
+
+def test7():
+    # a subsampled loop nested in a loop: one mini-batch per outer iteration, and nothing
+    # computed from the batch positions hoisted above the plate. The batch is the whole
+    # data set, so the log density matches Stan's
+    code = """
+    data {
+      int N;
+      int G;
+      vector[N] x;
+      vector[N] z;
+    }
+    parameters {
+      real mu[G];
+    }
+    model {
+      mu ~ normal(0, 10);
+      for (g in 1:G)
+        for (n in 1:N)
+          z[n] ~ normal(mu[g] + x[n], 1);
+    }
+    """
+    m, e = compare_generated(7, code, {"N": 4, "G": 2, "x": [0.5, -1.0, 0.2, 1.5],
+                                       "z": [0.3, -0.7, 1.1, 0.4]},
+                             lib=Stan2PyroLibrary(subsample=4))
+    print(m, e)
+    assert m == 0, "test not successful"
+
+def test8():
+    # int division of data truncates as in Stan: (1 - 4) / 2 is -1, not Python's -2
+    code = """
+    data {
+      int K;
+      int M;
+    }
+    parameters {
+      real mu;
+    }
+    model {
+      mu ~ normal((K - M) / 2, 1);
+    }
+    """
+    m, e = compare_generated(8, code, {"K": 1, "M": 4})
+    print(m, e)
+    assert m == 0, "test not successful"
+
+def test9():
+    # independent iterations become one pyro.plate with a batched sample statement
+    code = """
+    data {
+      int N;
+      vector[N] x;
+      vector[N] y;
+    }
+    parameters {
+      real alpha;
+      real beta;
+      real<lower=0> sigma;
+    }
+    model {
+      alpha ~ normal(0, 10);
+      beta ~ normal(0, 10);
+      for (n in 1:N)
+        y[n] ~ normal(alpha + beta * x[n], sigma);
+    }
+    """
+    m, e = compare_generated(9, code, {"N": 4, "x": [0.5, -1.0, 0.2, 1.5],
+                                       "y": [1.1, -0.3, 0.6, 2.4]})
+    print(m, e)
+    assert m == 0, "test not successful"
+
+def test10():
+    # the mixture assignment marginalized by log_sum_exp becomes an enumerated
+    # categorical, which TraceEnum_ELBO sums out again
+    code = """
+    data {
+      int N;
+      int K;
+      real y[N];
+    }
+    parameters {
+      simplex[K] theta;
+      real mu[K];
+      real<lower=0> sigma;
+    }
+    model {
+      mu ~ normal(0, 10);
+      for (n in 1:N) {
+        real lps[K];
+        for (k in 1:K)
+          lps[k] = log(theta[k]) + normal_lpdf(y[n] | mu[k], sigma);
+        target += log_sum_exp(lps);
+      }
+    }
+    """
+    m, e = compare_generated(10, code, {"N": 5, "K": 2, "y": [-1.2, 0.3, 2.5, 2.1, -0.7]})
+    print(m, e)
+    assert m == 0, "test not successful"
+
+def test11():
+    # a subsampled likelihood loop; a batch of the whole data set matches Stan exactly
+    code = """
+    data {
+      int N;
+      vector[N] y;
+    }
+    parameters {
+      real mu;
+      real<lower=0> sigma;
+    }
+    model {
+      mu ~ normal(0, 10);
+      for (n in 1:N)
+        y[n] ~ normal(mu, sigma);
+    }
+    """
+    m, e = compare_generated(11, code, {"N": 4, "y": [0.3, -0.7, 1.1, 0.4]},
+                             lib=Stan2PyroLibrary(subsample=4))
+    print(m, e)
+    assert m == 0, "test not successful"
+
+def test12():
+    # accumulation loops become torch.sum and torch.logsumexp
+    code = """
+    data {
+      int N;
+      vector[N] x;
+    }
+    parameters {
+      real mu;
+    }
+    model {
+      real s;
+      real m;
+      s = 0;
+      for (n in 1:N)
+        s = s + x[n] * mu;
+      m = 0;
+      for (n in 1:N)
+        m = log_sum_exp(m, x[n] * mu);
+      mu ~ normal(0, 1);
+      target += s - m;
+    }
+    """
+    m, e = compare_generated(12, code, {"N": 4, "x": [0.5, -1.0, 0.2, 1.5]})
+    print(m, e)
+    assert m == 0, "test not successful"
+
+def test13():
+    # 1-based categorical outcomes are observed 0-based, and keep their values
+    code = """
+    data {
+      int N;
+      int K;
+      int z[N];
+      int w[N];
+    }
+    parameters {
+      simplex[K] theta;
+      vector[K] beta;
+    }
+    model {
+      beta ~ normal(0, 1);
+      for (n in 1:N) {
+        z[n] ~ categorical(theta);
+        w[n] ~ categorical_logit(beta);
+      }
+    }
+    """
+    m, e = compare_generated(13, code, {"N": 4, "K": 3, "z": [1, 3, 2, 3], "w": [2, 1, 3, 3]})
+    print(m, e)
+    assert m == 0, "test not successful"
+
+def test14():
+    # the variates of categorical log densities are shifted to 0-based
+    code = """
+    data {
+      int N;
+      int K;
+      int z[N];
+    }
+    parameters {
+      simplex[K] theta;
+      vector[K] beta;
+    }
+    model {
+      beta ~ normal(0, 1);
+      for (n in 1:N)
+        target += categorical_lpmf(z[n] | theta) + categorical_logit_lpmf(z[n] | beta);
+    }
+    """
+    m, e = compare_generated(14, code, {"N": 4, "K": 3, "z": [1, 3, 2, 3]})
+    print(m, e)
+    assert m == 0, "test not successful"
+
 def test3():
     n_samples = 1
     model_cache = "./test/model_3.stan.pkl"
@@ -210,9 +449,13 @@ def cache_all_models(args):
         n = len(list(filter(lambda x: x[1] == k, results)))
         print("%d : %d" % (k, n))
 
-def test_generic(dfile, mfile, pfile, n_runs, model_cache):
+def test_generic(dfile, mfile, pfile, n_runs, model_cache, compile_errors=None):
     try:
-        generate_pyro_file(mfile, pfile)
+        if compile_errors is None:
+            generate_pyro_file(mfile, pfile)
+        else:
+            # already compiled by generate_pyro_files
+            assert compile_errors[pfile] is None, "SYNTAX ERROR in Stan Code: %s" % compile_errors[pfile]
     except AssertionError as e:
         return handle_error("generate_pyro_file", e)
 
@@ -380,6 +623,15 @@ def test_all():
     test1()
     test2()
     test3()
+    test6()
+    test7()
+    test8()
+    test9()
+    test10()
+    test11()
+    test12()
+    test13()
+    test14()
 
 if __name__ == "__main__":
     test5()
\ No newline at end of file
@@ -1,4 +1,4 @@
 from .pyro_utils import *
-from .pyro_utils import _pyro_sample, _call_func, _index_select, _pyro_assign
+from .pyro_utils import _pyro_sample, _call_func, _index_select, _checked_index, _gather_index, _modulus, _int_divide, _pyro_assign, _as_tensor
 from .compiler_utils import *
 from .logger import *
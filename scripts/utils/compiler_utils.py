@@ -1,5 +1,8 @@
 import os
+import json
+import ctypes
 import collections
+import tempfile
 import numpy as np
 from os.path import join
 import subprocess
@@ -18,31 +21,145 @@ def sanitize_module_loading_file(pfile):
     return pfile
 
 
-def generate_pyro_file(mfile, pfile):
-    process = subprocess.Popen('../stan2pyro/bin/stan2pyro %s' % mfile, shell=True,
-                               stdin=subprocess.PIPE, stdout=subprocess.PIPE,
-                               stderr =subprocess.PIPE, close_fds=True)
+STAN2PYRO = '../stan2pyro/bin/stan2pyro'
+LIBSTAN2PYRO = '../stan2pyro/bin/libstan2pyro.so'
+STAN2PYRO_ERRORS = ["SYNTAX ERROR, MESSAGE(S) FROM PARSER", "Aborted (core dumped)", "SAMPLING CONSTANTS NOT SUPPORTED",
+                    "FEATURE NOT SUPPORTED"]
 
-    out, err = process.communicate()
-    out = out.decode('utf-8')
-    if err is None:
-        err = ""
-    else:
-        err = err.decode('utf-8')
 
+def write_pyro_file(mfile, pfile, out, err=""):
+    """
+    Write stan2pyro output to pfile behind the runtime imports, and fail if stan2pyro reported an error
+    """
     with open(pfile, "w") as f:
         f.write("# model file: %s\n" % mfile)
         f.write("from utils import to_float, _pyro_sample, _call_func, check_constraints\n")
         f.write("from utils import init_real, init_vector, init_matrix, init_int\n")
-        f.write("from utils import _index_select, to_int, _pyro_assign, as_bool\n")
-        f.write("import torch\nimport pyro\n")
+        f.write("from utils import _index_select, _checked_index, _gather_index, _modulus, _int_divide, to_int, _pyro_assign, as_bool, _as_tensor\n")
+        f.write("import torch\nimport pyro\nimport pyro.distributions as dist\n")
         # TODO remove to_variable
         f.write("from utils import identity as to_variable\n\n")
         f.write(out + "\n")
-        for err_s in ["SYNTAX ERROR, MESSAGE(S) FROM PARSER", "Aborted (core dumped)", "SAMPLING CONSTANTS NOT SUPPORTED"]:
+        for err_s in STAN2PYRO_ERRORS:
             assert err_s not in out and err_s not in err, "SYNTAX ERROR in Stan Code: %s" % err
 
 
+class Stan2PyroLibrary(object):
+    """
+    In-process stan2pyro: loads libstan2pyro once and compiles through its C interface (stan2pyro/stan2pyro.h)
+    options are stan2pyro_options_set keys, e.g. cache_dir="cache", include_path=["a", "b"]
+    """
+    ABI_VERSION = 1
+
+    def __init__(self, path=LIBSTAN2PYRO, **options):
+        lib = ctypes.CDLL(path)
+        lib.stan2pyro_abi_version.restype = ctypes.c_int
+        assert lib.stan2pyro_abi_version() == self.ABI_VERSION, "incompatible libstan2pyro: %s" % path
+        lib.stan2pyro_options_new.restype = ctypes.c_void_p
+        lib.stan2pyro_options_set.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p]
+        lib.stan2pyro_options_set.restype = ctypes.c_int
+        lib.stan2pyro_options_free.argtypes = [ctypes.c_void_p]
+        lib.stan2pyro_compile.argtypes = [ctypes.c_char_p, ctypes.c_void_p]
+        lib.stan2pyro_compile.restype = ctypes.c_void_p
+        lib.stan2pyro_result_ok.argtypes = [ctypes.c_void_p]
+        lib.stan2pyro_result_ok.restype = ctypes.c_int
+        for fn in [lib.stan2pyro_result_python, lib.stan2pyro_result_diagnostics]:
+            fn.argtypes = [ctypes.c_void_p]
+            fn.restype = ctypes.c_char_p
+        lib.stan2pyro_result_free.argtypes = [ctypes.c_void_p]
+        self.lib = lib
+        self.options = lib.stan2pyro_options_new()
+        for key in options:
+            values = options[key] if isinstance(options[key], list) else [options[key]]
+            for value in values:
+                ret = lib.stan2pyro_options_set(self.options, key.encode('utf-8'), str(value).encode('utf-8'))
+                assert ret == 0, "invalid stan2pyro option %s=%s" % (key, value)
+
+    def compile(self, code):
+        """
+        returns (python code or None on failure, diagnostics dict)
+        """
+        res = self.lib.stan2pyro_compile(code.encode('utf-8'), self.options)
+        assert res, "stan2pyro_compile: out of memory"
+        try:
+            diagnostics = json.loads(self.lib.stan2pyro_result_diagnostics(res).decode('utf-8'))
+            python = self.lib.stan2pyro_result_python(res).decode('utf-8') if self.lib.stan2pyro_result_ok(res) else None
+        finally:
+            self.lib.stan2pyro_result_free(res)
+        return python, diagnostics
+
+    def __del__(self):
+        if getattr(self, "options", None):
+            self.lib.stan2pyro_options_free(self.options)
+            self.options = None
+
+
+def generate_pyro_file(mfile, pfile, cache_dir=None, lib=None):
+    """
+    compile mfile into pfile with the stan2pyro binary, or in-process when lib is a Stan2PyroLibrary
+    """
+    if lib is not None:
+        with open(mfile, "r") as f:
+            python, diagnostics = lib.compile(f.read())
+        write_pyro_file(mfile, pfile, python or "", diagnostics["messages"])
+        return
+    cache_opt = "" if cache_dir is None else "--cache-dir %s " % cache_dir
+    process = subprocess.Popen('%s %s%s' % (STAN2PYRO, cache_opt, mfile), shell=True,
+                               stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                               stderr =subprocess.PIPE, close_fds=True)
+
+    out, err = process.communicate()
+    out = out.decode('utf-8')
+    if err is None:
+        err = ""
+    else:
+        err = err.decode('utf-8')
+    write_pyro_file(mfile, pfile, out, err)
+
+
+def generate_pyro_files(pairs, n_jobs=None, cache_dir=None):
+    """
+    Compile many (mfile, pfile) pairs in a single stan2pyro --batch process;
+    with cache_dir, unchanged models are served from stan2pyro's compile cache
+    returns {pfile: None if it compiled, else the stan2pyro error message}
+    """
+    with tempfile.NamedTemporaryFile("w", suffix=".txt", delete=False) as manifest:
+        for (mfile, pfile) in pairs:
+            manifest.write("%s %s\n" % (mfile, pfile))
+    summary_file = manifest.name + ".json"
+    cmd = [STAN2PYRO, "--batch", manifest.name, "--summary", summary_file]
+    if n_jobs is not None:
+        cmd += ["--jobs", str(n_jobs)]
+    if cache_dir is not None:
+        cmd += ["--cache-dir", cache_dir]
+    try:
+        subprocess.call(cmd)
+        with open(summary_file, "r") as f:
+            summary = json.load(f)
+    finally:
+        os.remove(manifest.name)
+        if os.path.exists(summary_file):
+            os.remove(summary_file)
+    if "cache" in summary:
+        print("stan2pyro cache: %(hits)d hits, %(misses)d misses, %(evictions)d evictions" % summary["cache"])
+
+    errors = {}
+    mfiles = dict((pfile, mfile) for (mfile, pfile) in pairs)
+    for entry in summary["files"]:
+        pfile = entry["output"]
+        errors[pfile] = entry["message"] if entry["message"] else "stan2pyro failed"
+        if entry["status"] != "ok":
+            continue
+        with open(pfile, "r") as f:
+            out = f.read()
+        try:
+            write_pyro_file(mfiles[pfile], pfile, out)
+            errors[pfile] = None
+        except AssertionError as e:
+            errors[pfile] = str(e)
+    return errors
+
+
 def get_fns_pyro(pfile):
     pfile = sanitize_module_loading_file(pfile)
     mk_module(pfile)
@@ -144,7 +261,7 @@ def handle_error(stage, e, etb=None):
     elif stage == "generate_pyro_file":
         if isinstance(e, AssertionError) and "SYNTAX ERROR in Stan Code" in str(e):
             err_id = 13
-            if "const stan::lang::" in trace_v:
+            if "const stan::lang::" in trace_v or "FEATURE NOT SUPPORTED" in trace_v:
                 err_id = 18
 
     elif stage == "json_file_to_mem_format":
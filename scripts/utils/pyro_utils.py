@@ -25,6 +25,36 @@ def _index_select(arr, ix):
         assert False, "invalid index selection"
 
 
+def _checked_index(ix):
+    # torch rejects positions past the end, but a negative one would
+    # count from the end instead
+    ix = to_int(ix)
+    assert ix >= 0, "index out of range: %d" % (ix + 1)
+    return ix
+
+
+def _modulus(x, y):
+    # Stan's int % truncates toward zero, as in C++, where Python's floors
+    x, y = to_int(x), to_int(y)
+    r = abs(x) % abs(y)
+    return r if x >= 0 else -r
+
+
+def _int_divide(x, y):
+    # Stan's int / truncates toward zero, as in C++, where Python's // floors
+    x, y = to_int(x), to_int(y)
+    q = abs(x) // abs(y)
+    return q if (x >= 0) == (y >= 0) else -q
+
+
+def _gather_index(ix):
+    # 1-based int data to the 0-based positions of a gather, checked as
+    # in _checked_index
+    ix = (_as_tensor(ix) - 1).long()
+    assert ix.numel() == 0 or ix.min().item() >= 0, "index out of range: %d" % (ix.min().item() + 1)
+    return ix
+
+
 def _call_func(fname, args):
     kwargs ={}
     if fname.startswith("stan::math::"):
@@ -74,6 +104,13 @@ def _call_func(fname, args):
         assert False, "Cannot handle function=%s(%s,%s)" % (fname,len(args),len(kwargs))
 
 
+def _as_tensor(x):
+    # int and real values may be Python numbers at run time
+    if isinstance(x, torch.Tensor):
+        return x
+    return to_variable(x)
+
+
 def identity(x):
     return x
 
@@ -128,6 +165,8 @@ def _pyro_assign(lhs, rhs):
         if shape_dim == 0 or (shape_dim == 1 and lhs.shape[0]==1):
             return to_float(rhs)
         else:
+            if not isinstance(rhs, torch.Tensor):
+                rhs = to_variable(rhs)
             return rhs.expand_as(lhs)
     elif isinstance(lhs,float):
         return to_float(rhs)
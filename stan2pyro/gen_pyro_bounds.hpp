@@ -0,0 +1,278 @@
+#ifndef STAN2PYRO_GEN_PYRO_BOUNDS_HPP
+#define STAN2PYRO_GEN_PYRO_BOUNDS_HPP
+
+#include <stan/lang/ast.hpp>
+#include <gen_pyro_context.hpp>
+#include <gen_pyro_ir.hpp>
+#include <gen_pyro_lower.hpp>
+#include <boost/variant/apply_visitor.hpp>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace stan {
+  namespace lang {
+
+    /**
+     * Visitor returning the declared range of an int variable, or null
+     * for other declarations.
+     */
+    struct pyro_int_range_vis : public boost::static_visitor<const range*> {
+      template <typename D>
+      const range* operator()(const D& /*x*/) const { return 0; }
+
+      const range* operator()(const int_var_decl& x) const { return &x.range_; }
+    };
+
+    /**
+     * Bounds-check elimination.  Marks the accesses whose single
+     * indexes are proven within the extents of the indexed variable
+     * (see pyro_ir_expr::in_bounds_), so that the printer subscripts
+     * them directly and sends only the others through the checked
+     * _checked_index of the run time:
+     *
+     *   vector[N] mu;  int<lower=1, upper=J> group[N];  vector[J] alpha;
+     *   for (n in 1:N) mu[n] = alpha[group[n]];
+     *
+     *   for n in range(0, to_int(N)):
+     *       mu[n] = alpha[int(group[n]) - 1]
+     *
+     * An index is in bounds when its least value is at least 1 and its
+     * greatest is at most the extent, both found from the bounds of the
+     * enclosing for loops, integer literals and offsets, and the
+     * declared bounds of data ints, which are checked when the data is
+     * read and never change.  Greatest values and extents compare as a
+     * data variable plus a constant.  Runs last, once the loops have
+     * been rebased and the shapes inferred.
+     */
+    class pyro_bounds_analysis {
+      pyro_codegen_context& ctx_;
+
+      /**
+       * Least value of an int, when known.
+       */
+      struct lower_bound {
+        bool known_;
+        long c_;
+        lower_bound() : known_(false), c_(0) { }
+        explicit lower_bound(long c) : known_(true), c_(c) { }
+      };
+
+      /**
+       * Greatest value of an int, sym_ + c_, or c_ if sym_ is null, when
+       * known.
+       */
+      struct upper_bound {
+        bool known_;
+        pyro_ir_expr_ptr sym_;
+        long c_;
+        upper_bound() : known_(false), c_(0) { }
+        upper_bound(const pyro_ir_expr_ptr& sym, long c) : known_(true), sym_(sym), c_(c) { }
+      };
+
+      /**
+       * Bounds of the variables of the enclosing for loops.
+       */
+      std::map<std::string, std::pair<lower_bound, upper_bound> > loops_;
+
+      /**
+       * Values of the compiler temporaries bound so far.
+       */
+      std::map<std::string, pyro_ir_expr_ptr> temps_;
+
+      /**
+       * Declared bounds of the data ints looked up so far; null where
+       * there is none.
+       */
+      std::map<std::string, std::pair<pyro_ir_expr_ptr, pyro_ir_expr_ptr> > declared_;
+
+      const std::pair<pyro_ir_expr_ptr, pyro_ir_expr_ptr>& declared(const std::string& name) {
+        std::map<std::string, std::pair<pyro_ir_expr_ptr, pyro_ir_expr_ptr> >::iterator it
+          = declared_.find(name);
+        if (it != declared_.end()) return it->second;
+        std::pair<pyro_ir_expr_ptr, pyro_ir_expr_ptr> bounds;
+        const pyro_symbol* sym = ctx_.symbols_.find(name);
+        pyro_int_range_vis vis;
+        if (const range* r = sym ? boost::apply_visitor(vis, sym->decl_->decl_) : 0) {
+          pyro_ir_lowering lw(ctx_, PYRO_DATA_BLOCK);
+          if (r->has_low()) bounds.first = lw.expression(r->low_);
+          if (r->has_high()) bounds.second = lw.expression(r->high_);
+        }
+        return declared_.insert(std::make_pair(name, bounds)).first->second;
+      }
+
+      /**
+       * @return the data int variable e reads directly or as an
+       * element, or null
+       */
+      static const pyro_ir_expr* data_int(const pyro_ir_expr_ptr& e) {
+        if (e->type_.dtype() != PYRO_IR_INT || !e->type_.is_scalar()) return 0;
+        const pyro_ir_expr* v = e.get();
+        if (v->kind_ == PYRO_IR_INDEX) v = v->args_[0].get();
+        return v->kind_ == PYRO_IR_VAR && v->block_ == PYRO_DATA_BLOCK ? v : 0;
+      }
+
+      /**
+       * @return e with the to_int conversions and temporaries around its
+       * value looked through
+       */
+      pyro_ir_expr_ptr value(pyro_ir_expr_ptr e) const {
+        for (;;) {
+          if (e->kind_ == PYRO_IR_PYTHON && e->name_ == "to_int") {
+            e = e->args_[0];
+            continue;
+          }
+          std::map<std::string, pyro_ir_expr_ptr>::const_iterator t;
+          if (e->kind_ == PYRO_IR_VAR && (t = temps_.find(e->name_)) != temps_.end()) {
+            e = t->second;
+            continue;
+          }
+          return e;
+        }
+      }
+
+      static bool is_offset(const pyro_ir_expr& e) {
+        return e.kind_ == PYRO_IR_BINARY && (e.name_ == "+" || e.name_ == "-")
+          && e.type_.dtype() == PYRO_IR_INT && e.args_[1]->is_int_literal();
+      }
+
+      lower_bound lower(pyro_ir_expr_ptr e) {
+        e = value(e);
+        if (e->is_int_literal()) return lower_bound(long(e->value_));
+        if (e->kind_ == PYRO_IR_VAR && loops_.count(e->name_))
+          return loops_[e->name_].first;
+        if (e->kind_ == PYRO_IR_BINARY && e->name_ == "+"
+            && e->type_.dtype() == PYRO_IR_INT) {
+          lower_bound a = lower(e->args_[0]), b = lower(e->args_[1]);
+          if (a.known_ && b.known_) return lower_bound(a.c_ + b.c_);
+        } else if (is_offset(*e)) {
+          lower_bound a = lower(e->args_[0]);
+          if (a.known_) return lower_bound(a.c_ - long(e->args_[1]->value_));
+        } else if (const pyro_ir_expr* v = data_int(e)) {
+          const pyro_ir_expr_ptr& lb = declared(v->name_).first;
+          if (lb && lb->is_int_literal()) return lower_bound(long(lb->value_));
+        }
+        return lower_bound();
+      }
+
+      /**
+       * @param[in] e int expression
+       * @param[in] exact true to accept only the forms of which the
+       * bound is the value itself, as needed for extents
+       * @return greatest value of e
+       */
+      upper_bound upper(pyro_ir_expr_ptr e, bool exact) {
+        e = value(e);
+        if (e->is_int_literal()) return upper_bound(pyro_ir_expr_ptr(), long(e->value_));
+        if (e->kind_ == PYRO_IR_VAR && e->block_ == PYRO_DATA_BLOCK
+            && e->type_.dtype() == PYRO_IR_INT && e->type_.is_scalar())
+          return upper_bound(e, 0);
+        if (is_offset(*e)) {
+          upper_bound a = upper(e->args_[0], exact);
+          long c = long(e->args_[1]->value_);
+          if (a.known_) a.c_ += e->name_ == "+" ? c : -c;
+          return a;
+        }
+        if (exact) return upper_bound();
+        if (e->kind_ == PYRO_IR_VAR && loops_.count(e->name_))
+          return loops_[e->name_].second;
+        if (const pyro_ir_expr* v = data_int(e)) {
+          const pyro_ir_expr_ptr& ub = declared(v->name_).second;
+          if (ub) return upper(ub, true);
+        }
+        return upper_bound();
+      }
+
+      /**
+       * @return true if a is known to be at most b
+       */
+      static bool at_most(const upper_bound& a, const upper_bound& b) {
+        if (!a.known_ || !b.known_ || a.c_ > b.c_) return false;
+        if (!a.sym_ || !b.sym_) return !a.sym_ && !b.sym_;
+        return pyro_ir_same_extent(a.sym_, b.sym_);
+      }
+
+      /**
+       * @return true if the single indexes of e are all proven within
+       * the extents of the variable it indexes
+       */
+      bool in_bounds(const pyro_ir_expr& e) {
+        const pyro_ir_expr& base = *e.args_[0];
+        if (base.kind_ != PYRO_IR_VAR || base.type_.extents_.size() < e.args_.size() - 1)
+          return false;
+        for (size_t i = 1; i < e.args_.size(); ++i) {
+          const pyro_ir_expr_ptr& ix = e.args_[i];
+          // ranges and gathers are bounded by the run time
+          if (ix->kind_ == PYRO_IR_RANGE || !ix->type_.is_scalar()) continue;
+          lower_bound lo = lower(ix);
+          if (!lo.known_ || lo.c_ < 1) return false;
+          if (!at_most(upper(ix, false), upper(base.type_.extents_[i - 1], true)))
+            return false;
+        }
+        return true;
+      }
+
+      static bool has_single_index(const pyro_ir_expr& e) {
+        for (size_t i = 1; i < e.args_.size(); ++i)
+          if (e.args_[i]->kind_ != PYRO_IR_RANGE && e.args_[i]->type_.is_scalar())
+            return true;
+        return false;
+      }
+
+      pyro_ir_expr_ptr mark(const pyro_ir_expr_ptr& e) {
+        if (!e || e->args_.empty()) return e;
+        std::shared_ptr<pyro_ir_expr> r(new pyro_ir_expr(*e));
+        for (size_t i = 0; i < r->args_.size(); ++i)
+          r->args_[i] = mark(r->args_[i]);
+        if (r->kind_ == PYRO_IR_INDEX && has_single_index(*r)) {
+          ++ctx_.stats_.accesses_;
+          if ((r->in_bounds_ = in_bounds(*r))) ++ctx_.stats_.in_bounds_;
+        }
+        return r;
+      }
+
+      void run(std::vector<pyro_ir_stmt_ptr>& ss) {
+        for (size_t i = 0; i < ss.size(); ++i) {
+          pyro_ir_stmt& x = *ss[i];
+          // declarations print their initialization from text
+          if (x.kind_ != PYRO_IR_DECL) {
+            x.lhs_ = mark(x.lhs_);
+            x.rhs_ = mark(x.rhs_);
+            for (size_t j = 0; j < x.args_.size(); ++j)
+              x.args_[j] = mark(x.args_[j]);
+          }
+          if (x.kind_ == PYRO_IR_LET) temps_[x.lhs_->name_] = x.rhs_;
+          run(x.decls_);
+          if (x.kind_ == PYRO_IR_FOR) {
+            // a rebased loop runs one below its bounds
+            long shift = x.zero_based_ ? 1 : 0;
+            lower_bound lo = lower(x.args_[0]);
+            upper_bound hi = upper(x.args_[1], false);
+            lo.c_ -= shift;
+            hi.c_ -= shift;
+            loops_[x.name_] = std::make_pair(lo, hi);
+            run(x.body_);
+            loops_.erase(x.name_);
+          } else {
+            run(x.body_);
+          }
+          for (size_t j = 0; j < x.bodies_.size(); ++j)
+            run(x.bodies_[j]);
+        }
+      }
+
+    public:
+      explicit pyro_bounds_analysis(pyro_codegen_context& ctx)
+        : ctx_(ctx) { }
+
+      void run(pyro_ir_program& ir) {
+        run(ir.transformed_data_);
+        run(ir.transformed_parameters_);
+        run(ir.model_);
+      }
+    };
+
+  }
+}
+#endif
@@ -0,0 +1,107 @@
+#ifndef STAN2PYRO_GEN_PYRO_CONTEXT_HPP
+#define STAN2PYRO_GEN_PYRO_CONTEXT_HPP
+
+#include <stan/lang/ast.hpp>
+#include <gen_pyro_symbols.hpp>
+#include <pyro_compiler.hpp>
+#include <ostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace stan {
+  namespace lang {
+
+    /**
+     * Thrown when a program uses a Stan construct the Pyro backend
+     * cannot generate code for.  Code generation of that program stops,
+     * but the process (and other programs of a batch) carry on.
+     */
+    struct pyro_unsupported_error : public std::runtime_error {
+      /**
+       * @param[in] what unsupported construct
+       */
+      explicit pyro_unsupported_error(const std::string& what)
+        : std::runtime_error("FEATURE NOT SUPPORTED: " + what) { }
+    };
+
+    /**
+     * State shared by every visitor of one Pyro code generation run.
+     *
+     * Visitors are constructed once per AST node, so they hold a
+     * reference to a single context instead of copying the program.
+     */
+    struct pyro_codegen_context {
+      /**
+       * Parsed program, read-only for the whole run.
+       */
+      const program& p_;
+
+      /**
+       * Top-level variables of the program, built once from p_.
+       */
+      const pyro_symbol_table symbols_;
+
+      /**
+       * Options of the compilation.
+       */
+      const pyro_compile_options options_;
+
+      /**
+       * Remarks on the generated code, such as loops left unvectorized
+       * and why; reported with the parser messages.
+       */
+      std::vector<std::string> notes_;
+
+      /**
+       * Counts of the rewrites made by the optimization passes.
+       */
+      pyro_optimization_stats stats_;
+
+      /**
+       * Number of compiler temporaries named so far.
+       */
+      size_t n_temporaries_;
+
+      /**
+       * Transformed data and transformed parameters whose computation
+       * was eliminated as dead; they are neither exported nor extracted.
+       */
+      std::set<std::string> dead_;
+
+      /**
+       * Int data arrays that vectorized loops gather with; the data
+       * preparation converts each to positions once (see
+       * pyro_gather_index_name).
+       */
+      std::set<std::string> gather_indexes_;
+
+      /**
+       * Sink for the generated Python module.
+       */
+      std::ostream& o_;
+
+      /**
+       * Construct a context generating code for the specified program
+       * to the specified stream.
+       *
+       * @param[in] p parsed program; must outlive the context
+       * @param[in,out] o stream for the generated module
+       * @param[in] options compile options
+       */
+      pyro_codegen_context(const program& p, std::ostream& o,
+                           const pyro_compile_options& options = pyro_compile_options())
+        : p_(p), symbols_(p), options_(options), n_temporaries_(0), o_(o) { }
+
+      /**
+       * @return name of a new compiler temporary, unique in the module
+       */
+      std::string temporary() {
+        return pyro_temporary_name(++n_temporaries_);
+      }
+    };
+
+  }
+}
+#endif
@@ -0,0 +1,289 @@
+#ifndef STAN2PYRO_GEN_PYRO_CSE_HPP
+#define STAN2PYRO_GEN_PYRO_CSE_HPP
+
+#include <stan/lang/ast.hpp>
+#include <gen_pyro_context.hpp>
+#include <gen_pyro_ir.hpp>
+#include <gen_pyro_functions.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace stan {
+  namespace lang {
+
+    /**
+     * Common subexpression elimination within a statement list.
+     *
+     * Within one list (a block, a loop or branch body, or the
+     * statements of a generated function), a pure expression computed
+     * by two or more statements, or twice by one, is bound once to a
+     * compiler temporary just before the first statement that needs it:
+     *
+     *   y[n] ~ normal(alpha[group[n]] + beta * x[n], sigma);
+     *   z[n] ~ normal(alpha[group[n]] + beta * x[n], tau);
+     *
+     *   _t1__ = (alpha[to_int(group[n - 1]) - 1] + (beta * x[n - 1]))
+     *   y[n - 1] =  pyro.sample(..., dist.Normal(_t1__, sigma) ...
+     *   z[n - 1] =  pyro.sample(..., dist.Normal(_t1__, tau) ...
+     *
+     * Occurrences only match while none of the variables they read has
+     * been written in between, which the pass tracks by numbering the
+     * writes of each variable.  The largest shared expressions are bound
+     * first; their subexpressions only get temporaries of their own if
+     * they are also used elsewhere.  The branches of conditional
+     * expressions and the second operand of && and || may not run, so
+     * they are left alone, and a while condition is evaluated anew on
+     * each iteration.  Calls of user-defined, _rng and _lp functions are
+     * not pure.
+     */
+    class pyro_common_subexpressions {
+      pyro_codegen_context& ctx_;
+
+      /**
+       * State of the statement list being processed.
+       */
+      struct scope {
+        /**
+         * Number of writes of each variable so far.
+         */
+        std::map<std::string, int> versions_;
+
+        /**
+         * Every candidate occurrence: its key and the keys of the
+         * candidates containing it.
+         */
+        std::vector<std::pair<std::string, std::vector<std::string> > > occurrences_;
+
+        /**
+         * Number of nodes of each candidate.
+         */
+        std::map<std::string, size_t> sizes_;
+
+        /**
+         * Candidates bound to temporaries, and their temporaries once
+         * bound.
+         */
+        std::map<std::string, pyro_ir_expr_ptr> temps_;
+      };
+
+      static bool is_pure(const pyro_ir_expr& e) {
+        return e.kind_ != PYRO_IR_CALL
+          || !(e.user_defined_ || has_rng_suffix(e.name_) || has_lp_suffix(e.name_));
+      }
+
+      /**
+       * @return number of operands of e always evaluated with it
+       */
+      static size_t n_strict(const pyro_ir_expr& e) {
+        if (e.kind_ == PYRO_IR_CONDITIONAL) return 1;
+        if (e.kind_ == PYRO_IR_CALL && (e.name_ == "logical_or" || e.name_ == "logical_and"))
+          return 1;
+        return e.args_.size();
+      }
+
+      /**
+       * @return spelling of the value of e at this point of the list,
+       * equal for two expressions exactly when they compute the same
+       * value; empty if e is not pure
+       */
+      static std::string key(const scope& sc, const pyro_ir_expr_ptr& e, size_t& size) {
+        ++size;
+        if (!e) return "nil";
+        if (!is_pure(*e)) return "";
+        if (e->kind_ == PYRO_IR_LITERAL) return e->text_;
+        if (e->kind_ == PYRO_IR_VAR) {
+          std::map<std::string, int>::const_iterator v = sc.versions_.find(e->name_);
+          return e->name_ + "@" + boost::lexical_cast<std::string>(
+                   v == sc.versions_.end() ? 0 : v->second);
+        }
+        std::string k = boost::lexical_cast<std::string>(int(e->kind_)) + e->name_ + "(";
+        for (size_t i = 0; i < e->args_.size(); ++i) {
+          std::string a = key(sc, e->args_[i], size);
+          if (a.empty()) return "";
+          k += (i > 0 ? "," : "") + a;
+        }
+        return k + ")";
+      }
+
+      /**
+       * @return true if e is worth a temporary: an operation of the
+       * program, not a variable, literal, Python int conversion, the
+       * range of an index, which is no value, or an int offset i + c,
+       * which the printer folds into positions
+       */
+      static bool is_candidate(const pyro_ir_expr_ptr& e) {
+        return e && e->kind_ != PYRO_IR_LITERAL && e->kind_ != PYRO_IR_VAR
+          && e->kind_ != PYRO_IR_PYTHON && e->kind_ != PYRO_IR_RANGE
+          && !(e->kind_ == PYRO_IR_BINARY && (e->name_ == "+" || e->name_ == "-")
+               && e->type_.dtype() == PYRO_IR_INT && e->args_[1]->is_int_literal());
+      }
+
+      void collect(scope& sc, const pyro_ir_expr_ptr& e,
+                   std::vector<std::string> ancestors) {
+        if (!e) return;
+        if (is_candidate(e)) {
+          size_t size = 0;
+          std::string k = key(sc, e, size);
+          if (!k.empty()) {
+            sc.occurrences_.push_back(std::make_pair(k, ancestors));
+            sc.sizes_[k] = size;
+            ancestors.push_back(k);
+          }
+        }
+        for (size_t i = 0; i < n_strict(*e); ++i)
+          collect(sc, e->args_[i], ancestors);
+      }
+
+      pyro_ir_expr_ptr rewrite(scope& sc, const pyro_ir_expr_ptr& e,
+                               std::vector<pyro_ir_stmt_ptr>& out) {
+        if (!is_candidate(e) && !(e && e->kind_ == PYRO_IR_RANGE)) return e;
+        size_t size = 0;
+        std::string k = key(sc, e, size);
+        std::map<std::string, pyro_ir_expr_ptr>::iterator t = sc.temps_.find(k);
+        if (!k.empty() && t != sc.temps_.end()) {
+          if (!t->second) {
+            std::shared_ptr<pyro_ir_expr> v(new pyro_ir_expr(PYRO_IR_VAR));
+            v->name_ = v->text_ = ctx_.temporary();
+            v->type_ = e->type_;
+            pyro_ir_stmt_ptr let(new pyro_ir_stmt(PYRO_IR_LET, PYRO_LOCAL_BLOCK, 0));
+            let->lhs_ = v;
+            let->rhs_ = e;
+            out.push_back(let);
+            ++ctx_.stats_.shared_;
+            t->second = v;
+          }
+          return t->second;
+        }
+        std::vector<pyro_ir_expr_ptr> args(e->args_);
+        for (size_t i = 0; i < n_strict(*e); ++i)
+          args[i] = rewrite(sc, e->args_[i], out);
+        return pyro_ir_with_args(*e, args);
+      }
+
+      /**
+       * Call f on each expression x evaluates when it starts, in place.
+       */
+      template <typename F>
+      static void for_each_expr(pyro_ir_stmt& x, F f) {
+        if (x.kind_ == PYRO_IR_DECL) return;
+        if (x.lhs_ && (x.lhs_->kind_ == PYRO_IR_INDEX || x.lhs_->kind_ == PYRO_IR_SLICE)) {
+          std::vector<pyro_ir_expr_ptr> args(x.lhs_->args_);
+          for (size_t i = 1; i < args.size(); ++i)
+            args[i] = f(args[i]);
+          x.lhs_ = pyro_ir_with_args(*x.lhs_, args);
+        }
+        if (x.kind_ != PYRO_IR_WHILE)
+          x.rhs_ = f(x.rhs_);
+        size_t n = x.kind_ == PYRO_IR_IF ? std::min<size_t>(1, x.args_.size()) : x.args_.size();
+        for (size_t i = 0; i < n; ++i)
+          x.args_[i] = f(x.args_[i]);
+      }
+
+      static void writes(const pyro_ir_stmt& x, std::set<std::string>& vars) {
+        if (const pyro_ir_expr* v = pyro_ir_base_var(x.lhs_))
+          if (x.kind_ != PYRO_IR_FACTOR && x.kind_ != PYRO_IR_EXPR)
+            vars.insert(v->name_);
+        if (x.kind_ == PYRO_IR_FOR) vars.insert(x.name_);
+        for (size_t i = 0; i < x.decls_.size(); ++i) writes(*x.decls_[i], vars);
+        for (size_t i = 0; i < x.body_.size(); ++i) writes(*x.body_[i], vars);
+        for (size_t i = 0; i < x.bodies_.size(); ++i)
+          for (size_t j = 0; j < x.bodies_[i].size(); ++j)
+            writes(*x.bodies_[i][j], vars);
+      }
+
+      static void bump(scope& sc, const pyro_ir_stmt& x) {
+        std::set<std::string> vars;
+        writes(x, vars);
+        for (std::set<std::string>::const_iterator it = vars.begin(); it != vars.end(); ++it)
+          ++sc.versions_[*it];
+      }
+
+      struct collector {
+        pyro_common_subexpressions* cse_;
+        scope* sc_;
+        pyro_ir_expr_ptr operator()(const pyro_ir_expr_ptr& e) const {
+          cse_->collect(*sc_, e, std::vector<std::string>());
+          return e;
+        }
+      };
+
+      struct rewriter {
+        pyro_common_subexpressions* cse_;
+        scope* sc_;
+        std::vector<pyro_ir_stmt_ptr>* out_;
+        pyro_ir_expr_ptr operator()(const pyro_ir_expr_ptr& e) const {
+          return cse_->rewrite(*sc_, e, *out_);
+        }
+      };
+
+      /**
+       * Bind the candidates that have two or more occurrences outside
+       * other bound candidates, largest first.
+       */
+      static void select(scope& sc) {
+        std::vector<std::pair<size_t, std::string> > by_size;
+        for (std::map<std::string, size_t>::const_iterator it = sc.sizes_.begin();
+             it != sc.sizes_.end(); ++it)
+          by_size.push_back(std::make_pair(it->second, it->first));
+        std::sort(by_size.rbegin(), by_size.rend());
+        for (size_t i = 0; i < by_size.size(); ++i) {
+          const std::string& k = by_size[i].second;
+          size_t n = 0;
+          for (size_t j = 0; j < sc.occurrences_.size() && n < 2; ++j) {
+            if (sc.occurrences_[j].first != k) continue;
+            const std::vector<std::string>& ancestors = sc.occurrences_[j].second;
+            bool exposed = true;
+            for (size_t a = 0; a < ancestors.size() && exposed; ++a)
+              exposed = !sc.temps_.count(ancestors[a]);
+            if (exposed) ++n;
+          }
+          if (n >= 2) sc.temps_[k] = pyro_ir_expr_ptr();
+        }
+      }
+
+    public:
+      explicit pyro_common_subexpressions(pyro_codegen_context& ctx)
+        : ctx_(ctx) { }
+
+      void run(std::vector<pyro_ir_stmt_ptr>& ss) {
+        for (size_t i = 0; i < ss.size(); ++i) {
+          run(ss[i]->body_);
+          for (size_t j = 0; j < ss[i]->bodies_.size(); ++j)
+            run(ss[i]->bodies_[j]);
+        }
+
+        scope sc;
+        collector c = {this, &sc};
+        for (size_t i = 0; i < ss.size(); ++i) {
+          for_each_expr(*ss[i], c);
+          bump(sc, *ss[i]);
+        }
+        select(sc);
+        if (sc.temps_.empty()) return;
+
+        sc.versions_.clear();
+        std::vector<pyro_ir_stmt_ptr> out;
+        rewriter r = {this, &sc, &out};
+        for (size_t i = 0; i < ss.size(); ++i) {
+          for_each_expr(*ss[i], r);
+          out.push_back(ss[i]);
+          bump(sc, *ss[i]);
+        }
+        ss.swap(out);
+      }
+
+      void run(pyro_ir_program& ir) {
+        run(ir.transformed_data_);
+        run(ir.transformed_parameters_);
+        run(ir.model_);
+      }
+    };
+
+  }
+}
+#endif
@@ -0,0 +1,181 @@
+#ifndef STAN2PYRO_GEN_PYRO_DCE_HPP
+#define STAN2PYRO_GEN_PYRO_DCE_HPP
+
+#include <stan/lang/ast.hpp>
+#include <gen_pyro_context.hpp>
+#include <gen_pyro_ir.hpp>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace stan {
+  namespace lang {
+
+    /**
+     * Dead code elimination.  Sampling statements, target increments
+     * and statements run for their side effects, such as calls of _lp,
+     * _rng and user-defined functions, are live; so is every statement
+     * computing a variable they read, directly or through other live
+     * statements, every loop or conditional around a live statement,
+     * and the break and continue statements of live loops.  Everything
+     * else is dropped: transformed parameters only needed by generated
+     * quantities, unused locals and temporaries, and transformed data
+     * the model never reads, which is then neither exported nor
+     * extracted.
+     *
+     * Liveness is per variable, not per definition: any assignment of a
+     * live variable is live.  Variables the caller asks for by name
+     * (pyro_compile_options::keep_) are live, and so are those the
+     * extents and bounds of the parameters read, which init_params
+     * needs.
+     */
+    class pyro_dead_code_eliminator {
+      pyro_codegen_context& ctx_;
+
+      /**
+       * Variables whose value is needed.
+       */
+      std::set<std::string> live_;
+
+      void read(const pyro_ir_expr_ptr& e) {
+        if (!e) return;
+        if (e->kind_ == PYRO_IR_VAR) live_.insert(e->name_);
+        for (size_t i = 0; i < e->args_.size(); ++i)
+          read(e->args_[i]);
+      }
+
+      void read(const std::vector<pyro_ir_expr_ptr>& es) {
+        for (size_t i = 0; i < es.size(); ++i)
+          read(es[i]);
+      }
+
+      /**
+       * @return true if evaluating e may have side effects: it calls
+       * an _lp, _rng or user-defined function
+       */
+      static bool has_side_effects(const pyro_ir_expr_ptr& e) {
+        if (!e) return false;
+        if (e->kind_ == PYRO_IR_CALL
+            && (e->user_defined_ || has_lp_suffix(e->name_) || has_rng_suffix(e->name_)))
+          return true;
+        for (size_t i = 0; i < e->args_.size(); ++i)
+          if (has_side_effects(e->args_[i])) return true;
+        return false;
+      }
+
+      static bool is_loop(const pyro_ir_stmt& x) {
+        return x.kind_ == PYRO_IR_FOR || x.kind_ == PYRO_IR_WHILE;
+      }
+
+      bool mark(const std::vector<pyro_ir_stmt_ptr>& ss, bool in_live_loop) {
+        bool live = false;
+        for (size_t i = 0; i < ss.size(); ++i)
+          live = mark(*ss[i], in_live_loop) || live;
+        return live;
+      }
+
+      /**
+       * Add the variables x reads to the live set if x is live.
+       *
+       * @param[in] x statement
+       * @param[in] in_live_loop true if the innermost loop around x is
+       * live, and with it the break and continue statements steering it
+       * @return true if x is live
+       */
+      bool mark(const pyro_ir_stmt& x, bool in_live_loop) {
+        switch (x.kind_) {
+          case PYRO_IR_DECL:
+            if (!live_.count(x.lhs_->name_)) return false;
+            read(x.args_);
+            return true;
+          case PYRO_IR_ASSIGN:
+          case PYRO_IR_LET:
+            if (!live_.count(pyro_ir_base_var(x.lhs_)->name_) && !has_side_effects(x.rhs_))
+              return false;
+            read(x.lhs_);
+            read(x.rhs_);
+            return true;
+          case PYRO_IR_SAMPLE:
+            read(x.lhs_);
+            read(x.args_);
+            return true;
+          case PYRO_IR_FACTOR:
+          case PYRO_IR_EXPR:
+            read(x.rhs_);
+            return true;
+          case PYRO_IR_VERBATIM:
+            return in_live_loop;
+          default: {
+            bool live;
+            if (is_loop(x)) {
+              // a loop is live for what its body computes; once it is,
+              // so are the jumps in it
+              live = mark(x.body_, false);
+              if (live) mark(x.body_, true);
+            } else {
+              live = mark(x.decls_, in_live_loop);
+              live = mark(x.body_, in_live_loop) || live;
+              for (size_t i = 0; i < x.bodies_.size(); ++i)
+                live = mark(x.bodies_[i], in_live_loop) || live;
+            }
+            if (live) {
+              read(x.rhs_);
+              read(x.args_);
+            }
+            return live;
+          }
+        }
+      }
+
+      /**
+       * Drop the statements of ss that are not live.
+       */
+      void sweep(std::vector<pyro_ir_stmt_ptr>& ss, bool in_live_loop) {
+        std::vector<pyro_ir_stmt_ptr> out;
+        for (size_t i = 0; i < ss.size(); ++i) {
+          pyro_ir_stmt& x = *ss[i];
+          if (!mark(x, in_live_loop)) {
+            ++ctx_.stats_.eliminated_;
+            if (x.kind_ == PYRO_IR_DECL && x.lhs_->block_ != PYRO_LOCAL_BLOCK)
+              ctx_.dead_.insert(x.lhs_->name_);
+            continue;
+          }
+          bool in_loop = in_live_loop || is_loop(x);
+          sweep(x.decls_, in_loop);
+          sweep(x.body_, in_loop);
+          for (size_t j = 0; j < x.bodies_.size(); ++j)
+            sweep(x.bodies_[j], in_loop);
+          out.push_back(ss[i]);
+        }
+        ss.swap(out);
+      }
+
+    public:
+      /**
+       * @param[in,out] ctx code generation state
+       * @param[in] keep variables to keep even if the model does not
+       * need them
+       */
+      pyro_dead_code_eliminator(pyro_codegen_context& ctx,
+                                const std::vector<std::string>& keep)
+        : ctx_(ctx), live_(keep.begin(), keep.end()) { }
+
+      void run(pyro_ir_program& ir) {
+        for (size_t i = 0; i < ir.parameters_.size(); ++i)
+          read(ir.parameters_[i]->args_);
+        size_t n;
+        do {
+          n = live_.size();
+          mark(ir.transformed_data_, false);
+          mark(ir.transformed_parameters_, false);
+          mark(ir.model_, false);
+        } while (live_.size() != n);
+        sweep(ir.transformed_data_, false);
+        sweep(ir.transformed_parameters_, false);
+        sweep(ir.model_, false);
+      }
+    };
+
+  }
+}
+#endif
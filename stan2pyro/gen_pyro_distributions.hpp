@@ -0,0 +1,135 @@
+#ifndef STAN2PYRO_GEN_PYRO_DISTRIBUTIONS_HPP
+#define STAN2PYRO_GEN_PYRO_DISTRIBUTIONS_HPP
+
+#include <stan/lang/ast.hpp>
+#include <gen_pyro_functions.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/unordered_map.hpp>
+#include <string>
+#include <vector>
+
+namespace stan {
+  namespace lang {
+
+    /**
+     * Pyro distribution of one signature of a Stan sampling statement.
+     */
+    struct pyro_distribution_def {
+      /**
+       * Stan distribution family.
+       */
+      const char* family_;
+
+      /**
+       * Argument types, as for pyro_function_def.
+       */
+      const char* signature_;
+
+      /**
+       * Python constructor, with $k and #k placeholders as for
+       * pyro_function_def.
+       */
+      const char* python_;
+
+      /**
+       * True for distributions of scalars, whose batch shape is the
+       * broadcast shape of the arguments; false for distributions of
+       * vectors and matrices, which are never expanded.
+       */
+      bool univariate_;
+
+      /**
+       * Stan value of Pyro's 0 for the variate, subtracted from
+       * observations: 1 for the 1-based outcomes of categorical, 0
+       * otherwise.
+       */
+      int offset_;
+    };
+
+    /**
+     * Stan families with a direct Pyro distribution, tried in order.
+     * Sampling statements of other families go through the run-time
+     * _pyro_sample lookup.
+     */
+    static const pyro_distribution_def pyro_distribution_defs[] = {
+      {"normal", "**", "dist.Normal($1, $2)", true, 0},
+      {"lognormal", "**", "dist.LogNormal($1, $2)", true, 0},
+      {"cauchy", "**", "dist.Cauchy($1, $2)", true, 0},
+      {"double_exponential", "**", "dist.Laplace($1, $2)", true, 0},
+      {"student_t", "***", "dist.StudentT($1, $2, $3)", true, 0},
+      {"exponential", "*", "dist.Exponential($1)", true, 0},
+      {"gamma", "**", "dist.Gamma($1, $2)", true, 0},
+      {"chi_square", "*", "dist.Chi2($1)", true, 0},
+      {"beta", "**", "dist.Beta($1, $2)", true, 0},
+      {"uniform", "**", "dist.Uniform($1, $2)", true, 0},
+      {"bernoulli", "*", "dist.Bernoulli($1)", true, 0},
+      {"bernoulli_logit", "*", "dist.Bernoulli(logits=$1)", true, 0},
+      {"binomial", "**", "dist.Binomial($1, $2)", true, 0},
+      {"binomial_logit", "**", "dist.Binomial($1, logits=$2)", true, 0},
+      {"poisson", "*", "dist.Poisson($1)", true, 0},
+      {"poisson_log", "*", "dist.Poisson(torch.exp(#1))", true, 0},
+      {"categorical", "c", "dist.Categorical($1)", false, 1},
+      {"categorical_logit", "c", "dist.Categorical(logits=$1)", false, 1},
+      {"dirichlet", "c", "dist.Dirichlet($1)", false, 0},
+      {"multi_normal", "cc", "dist.MultivariateNormal($1, covariance_matrix=$2)", false, 0},
+      {"multi_normal_cholesky", "cc", "dist.MultivariateNormal($1, scale_tril=$2)", false, 0}
+    };
+
+    /**
+     * Registry of the Pyro distributions of Stan families, indexed by
+     * family once per process.
+     */
+    class pyro_distribution_registry {
+      boost::unordered_map<std::string, std::vector<const pyro_distribution_def*> > defs_;
+
+      pyro_distribution_registry() {
+        size_t n = sizeof(pyro_distribution_defs) / sizeof(pyro_distribution_defs[0]);
+        for (size_t i = 0; i < n; ++i)
+          defs_[pyro_distribution_defs[i].family_].push_back(&pyro_distribution_defs[i]);
+      }
+
+    public:
+      static const pyro_distribution_registry& instance() {
+        static const pyro_distribution_registry registry;
+        return registry;
+      }
+
+      /**
+       * @param[in] family Stan distribution family
+       * @param[in] args argument types of the sampling statement
+       * @return distribution of the first signature matching the
+       * argument types, or null if there is none
+       */
+      const pyro_distribution_def* find(const std::string& family,
+                                        const std::vector<expr_type>& args) const {
+        boost::unordered_map<std::string, std::vector<const pyro_distribution_def*> >
+          ::const_iterator it = defs_.find(family);
+        if (it == defs_.end()) return 0;
+        for (size_t i = 0; i < it->second.size(); ++i)
+          if (pyro_matches_signature(it->second[i]->signature_, args))
+            return it->second[i];
+        return 0;
+      }
+    };
+
+    /**
+     * @param[in] name Stan function name
+     * @param[in] args argument types of a call, the variate first
+     * @return distribution of a call of a log density function, such
+     * as normal_lpdf(y | mu, sigma), or null if the function is not one
+     * or its family has no direct Pyro distribution
+     */
+    const pyro_distribution_def* pyro_density_distribution(const std::string& name,
+                                                           const std::vector<expr_type>& args) {
+      if (name.size() <= 5 || args.empty()
+          || !(boost::algorithm::ends_with(name, "_lpdf")
+               || boost::algorithm::ends_with(name, "_lpmf")))
+        return 0;
+      std::vector<expr_type> params(args.begin() + 1, args.end());
+      return pyro_distribution_registry::instance().find(name.substr(0, name.size() - 5),
+                                                         params);
+    }
+
+  }
+}
+#endif
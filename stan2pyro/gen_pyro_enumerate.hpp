@@ -0,0 +1,242 @@
+#ifndef STAN2PYRO_GEN_PYRO_ENUMERATE_HPP
+#define STAN2PYRO_GEN_PYRO_ENUMERATE_HPP
+
+#include <stan/lang/ast.hpp>
+#include <gen_pyro_context.hpp>
+#include <gen_pyro_ir.hpp>
+#include <gen_pyro_distributions.hpp>
+#include <gen_pyro_vectorize.hpp>
+#include <boost/variant/get.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace stan {
+  namespace lang {
+
+    /**
+     * Enumeration of mixture components.  A mixture that a Stan program
+     * marginalizes by hand with log_sum_exp becomes a categorical
+     * latent variable, which Pyro enumerates in parallel, followed by
+     * an observation from the chosen component:
+     *
+     *   for (n in 1:N) {
+     *     vector[K] lps;
+     *     for (k in 1:K)
+     *       lps[k] = log(theta[k]) + normal_lpdf(y[n] | mu[k], sigma);
+     *     target += log_sum_exp(lps);
+     *   }
+     *
+     *   with pyro.plate("y_plate1", to_int(N)):
+     *       _t1__ = pyro.sample("_t1__", dist.Categorical(theta), infer={"enumerate": "parallel"}) + 1
+     *       y[0:to_int(N)] =  pyro.sample(..., dist.Normal(mu[(_t1__ - 1).long()], sigma), obs=...)
+     *
+     * The latent variable holds the 1-based component, so that the
+     * component densities read it where they read k.  The weights must
+     * be log(theta[k]) for a simplex theta with one entry per component,
+     * or the log(theta) lps starts from before lps[k] += ...; the
+     * component densities must be those of data that does not depend
+     * on the component, from a univariate distribution with a Pyro
+     * counterpart whose arguments read k only as elements v[k].  Runs
+     * before vectorization, and rewrites only loops that it then puts in
+     * a plate: a latent variable sampled on every iteration of a
+     * sequential loop would take a new enumeration dimension each time.
+     */
+    class pyro_mixture_enumeration {
+      pyro_codegen_context& ctx_;
+
+      /**
+       * Number of sequential loops around the statements being visited.
+       */
+      size_t loops_;
+
+      /**
+       * @return ss, or the statements of the block without
+       * declarations that ss consists of
+       */
+      static const std::vector<pyro_ir_stmt_ptr>& unwrap(const std::vector<pyro_ir_stmt_ptr>& ss) {
+        if (ss.size() == 1 && ss[0]->kind_ == PYRO_IR_BLOCK && ss[0]->decls_.empty())
+          return ss[0]->body_;
+        return ss;
+      }
+
+      static bool is_log(const pyro_ir_expr_ptr& e) {
+        return e->kind_ == PYRO_IR_CALL && e->name_ == "log" && e->args_.size() == 1;
+      }
+
+      /**
+       * @return true if e is a + b, setting the terms
+       */
+      static bool is_sum(const pyro_ir_expr_ptr& e, pyro_ir_expr_ptr& a, pyro_ir_expr_ptr& b) {
+        if (e->args_.size() != 2
+            || !((e->kind_ == PYRO_IR_BINARY && e->name_ == "+")
+                 || (e->kind_ == PYRO_IR_CALL && e->name_ == "add")))
+          return false;
+        a = e->args_[0];
+        b = e->args_[1];
+        return true;
+      }
+
+      bool is_simplex(const pyro_ir_expr& v) const {
+        const pyro_symbol* sym = v.kind_ == PYRO_IR_VAR ? ctx_.symbols_.find(v.name_) : 0;
+        return sym && boost::get<simplex_var_decl>(&sym->decl_->decl_)
+          && v.type_.extents_.size() == 1;
+      }
+
+      /**
+       * @return true if e reads k only as elements v[k]
+       */
+      static bool reads_elements(const pyro_ir_expr_ptr& e, const std::string& k) {
+        if (!e || is_pyro_loop_element(*e, k)) return true;
+        if (e->is_var(k)) return false;
+        for (size_t i = 0; i < e->args_.size(); ++i)
+          if (!reads_elements(e->args_[i], k)) return false;
+        return true;
+      }
+
+      /**
+       * @return distribution of d if it is a component density of
+       * component k, or null
+       */
+      static const pyro_distribution_def* component_density(const pyro_ir_expr_ptr& d,
+                                                            const std::string& k) {
+        if (d->kind_ != PYRO_IR_CALL || d->user_defined_ || d->args_.empty())
+          return 0;
+        const pyro_distribution_def* def
+          = pyro_density_distribution(d->name_, pyro_ir_types(d->args_));
+        if (!def || !def->univariate_) return 0;
+        const pyro_ir_expr_ptr& y = d->args_[0];
+        const pyro_ir_expr* v = pyro_ir_base_var(y);
+        if (!v || (v->block_ != PYRO_DATA_BLOCK && v->block_ != PYRO_TRANSFORMED_DATA_BLOCK)
+            || !y->type_.is_scalar() || pyro_ir_uses(y, k))
+          return 0;
+        for (size_t i = 1; i < d->args_.size(); ++i)
+          if (!reads_elements(d->args_[i], k)) return 0;
+        return def;
+      }
+
+      /**
+       * Rewrite x if it is a for loop marginalizing a mixture.
+       */
+      void rewrite(pyro_ir_stmt& x) {
+        if (x.kind_ != PYRO_IR_FOR || loops_ > 0 || x.body_.size() != 1
+            || x.body_[0]->kind_ != PYRO_IR_BLOCK)
+          return;
+        const pyro_ir_stmt& block = *x.body_[0];
+        const std::vector<pyro_ir_stmt_ptr>& body = block.body_;
+        if (body.size() < 2 || body.size() > 3 || block.decls_.size() != 1) return;
+
+        // target += log_sum_exp(lps), lps declared by the block
+        const pyro_ir_stmt& f = *body.back();
+        if (f.kind_ != PYRO_IR_FACTOR || f.rhs_->kind_ != PYRO_IR_CALL
+            || f.rhs_->name_ != "log_sum_exp" || f.rhs_->args_.size() != 1
+            || f.rhs_->args_[0]->kind_ != PYRO_IR_VAR)
+          return;
+        const std::string& lps = f.rhs_->args_[0]->name_;
+        const pyro_ir_type& lps_type = block.decls_[0]->lhs_->type_;
+        if (!block.decls_[0]->lhs_->is_var(lps) || lps_type.rank() != 1
+            || lps_type.extents_.size() != 1)
+          return;
+
+        // for (k in 1:K) lps[k] = ...
+        const pyro_ir_stmt& loop = *body[body.size() - 2];
+        if (loop.kind_ != PYRO_IR_FOR || !loop.args_[0]->is_int_literal()
+            || loop.args_[0]->value_ != 1)
+          return;
+        const std::vector<pyro_ir_stmt_ptr>& components = unwrap(loop.body_);
+        if (components.size() != 1 || components[0]->kind_ != PYRO_IR_ASSIGN) return;
+        const pyro_ir_stmt& a = *components[0];
+        const std::string& k = loop.name_;
+        pyro_ir_expr_ptr weight, density;
+        if (!is_pyro_loop_element(*a.lhs_, k) || !a.lhs_->args_[0]->is_var(lps)
+            || !is_sum(a.rhs_, weight, density))
+          return;
+
+        pyro_ir_expr_ptr theta;
+        if (body.size() == 3) {
+          // lps = log(theta); ... lps[k] += density
+          const pyro_ir_stmt& init = *body[0];
+          if (init.kind_ != PYRO_IR_ASSIGN || !init.lhs_->is_var(lps) || !is_log(init.rhs_)
+              || !pyro_ir_equal(weight, a.lhs_))
+            return;
+          theta = init.rhs_->args_[0];
+        } else {
+          // lps[k] = log(theta[k]) + density, in either order
+          if (!is_log(weight)) std::swap(weight, density);
+          if (!is_log(weight) || !is_pyro_loop_element(*weight->args_[0], k)) return;
+          theta = weight->args_[0]->args_[0];
+        }
+        // one component per entry of theta, and no other entry of lps
+        if (!is_simplex(*theta)
+            || !pyro_ir_same_extent(loop.args_[1], theta->type_.extents_[0])
+            || !pyro_ir_same_extent(lps_type.extents_[0], theta->type_.extents_[0]))
+          return;
+        const pyro_distribution_def* def = component_density(density, k);
+        if (!def) return;
+
+        std::shared_ptr<pyro_ir_expr> z(new pyro_ir_expr(PYRO_IR_VAR));
+        z->name_ = z->text_ = "_z__";
+        z->type_ = pyro_ir_type(expr_type(base_expr_type(int_type()), 1));
+        pyro_ir_stmt_ptr latent(new pyro_ir_stmt(PYRO_IR_SAMPLE, x.block_, x.line_));
+        latent->lhs_ = z;
+        latent->name_ = "categorical";
+        latent->args_.push_back(theta);
+        latent->enumerated_ = true;
+        pyro_ir_stmt_ptr observed(new pyro_ir_stmt(PYRO_IR_SAMPLE, x.block_, x.line_));
+        observed->lhs_ = density->args_[0];
+        observed->name_ = def->family_;
+        for (size_t i = 1; i < density->args_.size(); ++i)
+          observed->args_.push_back(pyro_index_loop_elements(density->args_[i], k, z));
+        pyro_ir_stmt enumerated(x);
+        enumerated.body_.clear();
+        enumerated.body_.push_back(latent);
+        enumerated.body_.push_back(observed);
+        if (!pyro_loop_analysis(enumerated).vectorizable()) return;
+        z->name_ = z->text_ = ctx_.temporary();
+        x.body_ = enumerated.body_;
+        ++ctx_.stats_.enumerated_;
+      }
+
+    public:
+      explicit pyro_mixture_enumeration(pyro_codegen_context& ctx)
+        : ctx_(ctx), loops_(0) { }
+
+      void run(std::vector<pyro_ir_stmt_ptr>& ss) {
+        for (size_t i = 0; i < ss.size(); ++i) {
+          pyro_ir_stmt& x = *ss[i];
+          rewrite(x);
+          bool loop = x.kind_ == PYRO_IR_FOR || x.kind_ == PYRO_IR_WHILE;
+          loops_ += loop;
+          run(x.decls_);
+          run(x.body_);
+          for (size_t j = 0; j < x.bodies_.size(); ++j)
+            run(x.bodies_[j]);
+          loops_ -= loop;
+        }
+      }
+
+      void run(pyro_ir_program& ir) {
+        run(ir.model_);
+      }
+    };
+
+    /**
+     * @return depth of the deepest nest of plates in ss, which
+     * TraceEnum_ELBO needs as max_plate_nesting to keep the dimensions
+     * it enumerates to their left
+     */
+    size_t pyro_max_plate_nesting(const std::vector<pyro_ir_stmt_ptr>& ss) {
+      size_t n = 0;
+      for (size_t i = 0; i < ss.size(); ++i) {
+        const pyro_ir_stmt& x = *ss[i];
+        size_t m = std::max(pyro_max_plate_nesting(x.decls_), pyro_max_plate_nesting(x.body_));
+        for (size_t j = 0; j < x.bodies_.size(); ++j)
+          m = std::max(m, pyro_max_plate_nesting(x.bodies_[j]));
+        n = std::max(n, m + (x.kind_ == PYRO_IR_PLATE ? 1 : 0));
+      }
+      return n;
+    }
+
+  }
+}
+#endif
@@ -0,0 +1,377 @@
+#ifndef STAN2PYRO_GEN_PYRO_FOLD_HPP
+#define STAN2PYRO_GEN_PYRO_FOLD_HPP
+
+#include <stan/lang/ast.hpp>
+#include <gen_pyro_context.hpp>
+#include <gen_pyro_ir.hpp>
+#include <boost/math/constants/constants.hpp>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace stan {
+  namespace lang {
+
+    typedef double (*pyro_fold_fn1)(double);
+    typedef double (*pyro_fold_fn2)(double, double);
+
+    inline double pyro_fold_square(double x) { return x * x; }
+    inline double pyro_fold_inv(double x) { return 1 / x; }
+    inline double pyro_fold_inv_sqrt(double x) { return 1 / std::sqrt(x); }
+    inline double pyro_fold_inv_square(double x) { return 1 / (x * x); }
+    inline double pyro_fold_inv_logit(double x) { return 1 / (1 + std::exp(-x)); }
+    inline double pyro_fold_logit(double x) { return std::log(x / (1 - x)); }
+    inline double pyro_fold_log1m(double x) { return std::log1p(-x); }
+    inline double pyro_fold_Phi(double x) { return 0.5 * std::erfc(-x / std::sqrt(2.0)); }
+    inline double pyro_fold_step(double x) { return x < 0 ? 0 : 1; }
+    inline double pyro_fold_int_step(double x) { return x > 0 ? 1 : 0; }
+    inline double pyro_fold_add(double x, double y) { return x + y; }
+    inline double pyro_fold_subtract(double x, double y) { return x - y; }
+    inline double pyro_fold_multiply(double x, double y) { return x * y; }
+    inline double pyro_fold_divide(double x, double y) { return x / y; }
+    inline double pyro_fold_lt(double x, double y) { return x < y; }
+    inline double pyro_fold_lte(double x, double y) { return x <= y; }
+    inline double pyro_fold_gt(double x, double y) { return x > y; }
+    inline double pyro_fold_gte(double x, double y) { return x >= y; }
+    inline double pyro_fold_eq(double x, double y) { return x == y; }
+    inline double pyro_fold_neq(double x, double y) { return x != y; }
+    inline double pyro_fold_or(double x, double y) { return x != 0 || y != 0; }
+    inline double pyro_fold_and(double x, double y) { return x != 0 && y != 0; }
+
+    /**
+     * @param[in] name Stan function of one real argument without side
+     * effects
+     * @return its value on doubles, or null if the function is not one
+     * the folder evaluates
+     */
+    pyro_fold_fn1 pyro_fold_unary_function(const std::string& name) {
+      static std::map<std::string, pyro_fold_fn1> fns;
+      if (fns.empty()) {
+        fns["sqrt"] = static_cast<pyro_fold_fn1>(std::sqrt);
+        fns["cbrt"] = static_cast<pyro_fold_fn1>(std::cbrt);
+        fns["exp"] = static_cast<pyro_fold_fn1>(std::exp);
+        fns["exp2"] = static_cast<pyro_fold_fn1>(std::exp2);
+        fns["expm1"] = static_cast<pyro_fold_fn1>(std::expm1);
+        fns["log"] = static_cast<pyro_fold_fn1>(std::log);
+        fns["log2"] = static_cast<pyro_fold_fn1>(std::log2);
+        fns["log10"] = static_cast<pyro_fold_fn1>(std::log10);
+        fns["log1p"] = static_cast<pyro_fold_fn1>(std::log1p);
+        fns["fabs"] = static_cast<pyro_fold_fn1>(std::fabs);
+        fns["abs"] = static_cast<pyro_fold_fn1>(std::fabs);
+        fns["floor"] = static_cast<pyro_fold_fn1>(std::floor);
+        fns["ceil"] = static_cast<pyro_fold_fn1>(std::ceil);
+        fns["round"] = static_cast<pyro_fold_fn1>(std::round);
+        fns["trunc"] = static_cast<pyro_fold_fn1>(std::trunc);
+        fns["sin"] = static_cast<pyro_fold_fn1>(std::sin);
+        fns["cos"] = static_cast<pyro_fold_fn1>(std::cos);
+        fns["tan"] = static_cast<pyro_fold_fn1>(std::tan);
+        fns["asin"] = static_cast<pyro_fold_fn1>(std::asin);
+        fns["acos"] = static_cast<pyro_fold_fn1>(std::acos);
+        fns["atan"] = static_cast<pyro_fold_fn1>(std::atan);
+        fns["sinh"] = static_cast<pyro_fold_fn1>(std::sinh);
+        fns["cosh"] = static_cast<pyro_fold_fn1>(std::cosh);
+        fns["tanh"] = static_cast<pyro_fold_fn1>(std::tanh);
+        fns["asinh"] = static_cast<pyro_fold_fn1>(std::asinh);
+        fns["acosh"] = static_cast<pyro_fold_fn1>(std::acosh);
+        fns["atanh"] = static_cast<pyro_fold_fn1>(std::atanh);
+        fns["erf"] = static_cast<pyro_fold_fn1>(std::erf);
+        fns["erfc"] = static_cast<pyro_fold_fn1>(std::erfc);
+        fns["lgamma"] = static_cast<pyro_fold_fn1>(std::lgamma);
+        fns["tgamma"] = static_cast<pyro_fold_fn1>(std::tgamma);
+        fns["square"] = pyro_fold_square;
+        fns["inv"] = pyro_fold_inv;
+        fns["inv_sqrt"] = pyro_fold_inv_sqrt;
+        fns["inv_square"] = pyro_fold_inv_square;
+        fns["inv_logit"] = pyro_fold_inv_logit;
+        fns["logit"] = pyro_fold_logit;
+        fns["log1m"] = pyro_fold_log1m;
+        fns["Phi"] = pyro_fold_Phi;
+        fns["step"] = pyro_fold_step;
+        fns["int_step"] = pyro_fold_int_step;
+      }
+      std::map<std::string, pyro_fold_fn1>::const_iterator it = fns.find(name);
+      return it == fns.end() ? 0 : it->second;
+    }
+
+    /**
+     * @param[in] name Stan function of two real arguments without side
+     * effects, or binary operator
+     * @return its value on doubles, or null if the function is not one
+     * the folder evaluates
+     */
+    pyro_fold_fn2 pyro_fold_binary_function(const std::string& name) {
+      static std::map<std::string, pyro_fold_fn2> fns;
+      if (fns.empty()) {
+        fns["+"] = fns["add"] = pyro_fold_add;
+        fns["-"] = fns["subtract"] = pyro_fold_subtract;
+        fns["*"] = fns["multiply"] = pyro_fold_multiply;
+        fns["/"] = fns["divide"] = pyro_fold_divide;
+        fns["pow"] = static_cast<pyro_fold_fn2>(std::pow);
+        fns["fmin"] = fns["min"] = static_cast<pyro_fold_fn2>(std::fmin);
+        fns["fmax"] = fns["max"] = static_cast<pyro_fold_fn2>(std::fmax);
+        fns["fdim"] = static_cast<pyro_fold_fn2>(std::fdim);
+        fns["fmod"] = static_cast<pyro_fold_fn2>(std::fmod);
+        fns["hypot"] = static_cast<pyro_fold_fn2>(std::hypot);
+        fns["atan2"] = static_cast<pyro_fold_fn2>(std::atan2);
+        fns["logical_lt"] = pyro_fold_lt;
+        fns["logical_lte"] = pyro_fold_lte;
+        fns["logical_gt"] = pyro_fold_gt;
+        fns["logical_gte"] = pyro_fold_gte;
+        fns["logical_eq"] = pyro_fold_eq;
+        fns["logical_neq"] = pyro_fold_neq;
+        fns["logical_or"] = pyro_fold_or;
+        fns["logical_and"] = pyro_fold_and;
+      }
+      std::map<std::string, pyro_fold_fn2>::const_iterator it = fns.find(name);
+      return it == fns.end() ? 0 : it->second;
+    }
+
+    /**
+     * @param[in] name Stan function of no arguments
+     * @param[out] x its value
+     * @return true if the function is a constant the folder knows
+     */
+    bool pyro_fold_constant_function(const std::string& name, double& x) {
+      using namespace boost::math::double_constants;
+      if (name == "pi") x = pi;
+      else if (name == "e") x = e;
+      else if (name == "sqrt2") x = root_two;
+      else if (name == "log2") x = ln_two;
+      else if (name == "log10") x = ln_ten;
+      else if (name == "machine_precision") x = std::numeric_limits<double>::epsilon();
+      else return false;
+      return true;
+    }
+
+    /**
+     * Constant folding and propagation over the IR.
+     *
+     * Operators and side-effect-free functions of literals are replaced
+     * by the literal of their value, following Stan's typing rules: the
+     * type checker's int or real type of the expression decides the type
+     * of the literal, and int division and modulus truncate as in
+     * Stan.  Values that are not finite or overflow a Stan int are left
+     * to run time.
+     *
+     * A scalar variable written once, by the assignment of a literal
+     * that runs whenever its scope does, is a constant: reads of it
+     * that follow the assignment are replaced by the literal and folded
+     * further.  The assignment itself stays, since transformed data is
+     * also exported to the caller.
+     */
+    class pyro_constant_folder {
+      pyro_codegen_context& ctx_;
+
+      /**
+       * Number of statements writing each variable, anywhere in the
+       * program.
+       */
+      std::map<std::string, size_t> writes_;
+
+      /**
+       * Number of loops and conditionals around the declaration of each
+       * variable the program declares.
+       */
+      std::map<std::string, int> scopes_;
+
+      /**
+       * Constant variables whose assignment has been seen.
+       */
+      std::map<std::string, pyro_ir_expr_ptr> constants_;
+
+      /**
+       * Number of loops and conditionals around the statement being
+       * folded.
+       */
+      int depth_;
+
+      void count_writes(const std::vector<pyro_ir_stmt_ptr>& ss) {
+        for (size_t i = 0; i < ss.size(); ++i) {
+          const pyro_ir_stmt& x = *ss[i];
+          if (x.kind_ == PYRO_IR_ASSIGN || x.kind_ == PYRO_IR_SAMPLE) {
+            const pyro_ir_expr* var = pyro_ir_base_var(x.lhs_);
+            if (var) ++writes_[var->name_];
+          }
+          if (x.kind_ == PYRO_IR_FOR) ++writes_[x.name_];
+          count_writes(x.decls_);
+          count_writes(x.body_);
+          for (size_t j = 0; j < x.bodies_.size(); ++j)
+            count_writes(x.bodies_[j]);
+        }
+      }
+
+      /**
+       * @return literal of value x of the type of e, or null if x does
+       * not fit that type
+       */
+      pyro_ir_expr_ptr literal(const pyro_ir_expr& e, double x) {
+        if (!std::isfinite(x)) return pyro_ir_expr_ptr();
+        switch (e.type_.dtype()) {
+          case PYRO_IR_INT:
+            if (x != std::floor(x) || x < std::numeric_limits<int>::min()
+                || x > std::numeric_limits<int>::max())
+              return pyro_ir_expr_ptr();
+            ++ctx_.stats_.folded_;
+            return pyro_ir_int(static_cast<long>(x));
+          case PYRO_IR_REAL:
+            ++ctx_.stats_.folded_;
+            return pyro_ir_real(x);
+          default:
+            return pyro_ir_expr_ptr();
+        }
+      }
+
+      /**
+       * @param[in] e node whose operands are folded literals
+       * @return the folded node, or null if it cannot be folded
+       */
+      pyro_ir_expr_ptr evaluate(const pyro_ir_expr& e) {
+        const std::vector<pyro_ir_expr_ptr>& a = e.args_;
+        if (!e.type_.is_scalar()) return pyro_ir_expr_ptr();
+        switch (e.kind_) {
+          case PYRO_IR_UNARY:
+            if (e.name_ == "-") return literal(e, -a[0]->value_);
+            if (e.name_ == "+") return literal(e, a[0]->value_);
+            if (e.name_ == "!") return literal(e, a[0]->value_ == 0);
+            return pyro_ir_expr_ptr();
+          case PYRO_IR_CONDITIONAL:
+            return literal(e, (a[0]->value_ != 0 ? a[1] : a[2])->value_);
+          case PYRO_IR_BINARY:
+          case PYRO_IR_CALL:
+            break;
+          default:
+            return pyro_ir_expr_ptr();
+        }
+        if (e.user_defined_) return pyro_ir_expr_ptr();
+        double x;
+        if (a.empty())
+          return pyro_fold_constant_function(e.name_, x) ? literal(e, x) : pyro_ir_expr_ptr();
+        if (a.size() == 1) {
+          if (e.name_ == "minus") return literal(e, -a[0]->value_);
+          if (e.name_ == "logical_negation") return literal(e, a[0]->value_ == 0);
+          pyro_fold_fn1 f = pyro_fold_unary_function(e.name_);
+          return f ? literal(e, f(a[0]->value_)) : pyro_ir_expr_ptr();
+        }
+        if (a.size() != 2) return pyro_ir_expr_ptr();
+        if (a[0]->is_int_literal() && a[1]->is_int_literal()) {
+          long l = static_cast<long>(a[0]->value_), r = static_cast<long>(a[1]->value_);
+          if (e.name_ == "/" || e.name_ == "divide")
+            return r == 0 ? pyro_ir_expr_ptr() : literal(e, l / r);
+          if (e.name_ == "%" || e.name_ == "modulus")
+            return r == 0 ? pyro_ir_expr_ptr() : literal(e, l % r);
+        }
+        pyro_fold_fn2 f = pyro_fold_binary_function(e.name_);
+        return f ? literal(e, f(a[0]->value_, a[1]->value_)) : pyro_ir_expr_ptr();
+      }
+
+      /**
+       * Fold the indexes of an assignment or sampling target, but not
+       * the variable itself.
+       */
+      pyro_ir_expr_ptr target(const pyro_ir_expr_ptr& e) {
+        if (!e || e->kind_ == PYRO_IR_VAR) return e;
+        if (e->kind_ != PYRO_IR_INDEX && e->kind_ != PYRO_IR_SLICE) return fold(e);
+        std::vector<pyro_ir_expr_ptr> args(1, target(e->args_[0]));
+        for (size_t i = 1; i < e->args_.size(); ++i)
+          args.push_back(fold(e->args_[i]));
+        return pyro_ir_with_args(*e, args);
+      }
+
+      void declare(const std::vector<pyro_ir_stmt_ptr>& decls) {
+        for (size_t i = 0; i < decls.size(); ++i)
+          if (decls[i]->kind_ == PYRO_IR_DECL && decls[i]->lhs_)
+            scopes_[decls[i]->lhs_->name_] = depth_;
+      }
+
+      /**
+       * Record x as the definition of a constant if it is one.
+       */
+      void define(const pyro_ir_stmt& x) {
+        if (x.kind_ != PYRO_IR_ASSIGN || !x.lhs_ || x.lhs_->kind_ != PYRO_IR_VAR
+            || !x.lhs_->type_.is_scalar() || !x.rhs_ || !x.rhs_->is_literal())
+          return;
+        const std::string& name = x.lhs_->name_;
+        std::map<std::string, int>::const_iterator scope = scopes_.find(name);
+        if (scope == scopes_.end() || scope->second != depth_ || writes_[name] != 1)
+          return;
+        // an int literal assigned to a real variable reads as a real
+        constants_[name] = x.lhs_->type_.dtype() == PYRO_IR_REAL && x.rhs_->is_int_literal()
+          ? pyro_ir_real(x.rhs_->value_) : x.rhs_;
+      }
+
+      void nested(std::vector<pyro_ir_stmt_ptr>& ss) {
+        ++depth_;
+        run(ss);
+        --depth_;
+      }
+
+    public:
+      explicit pyro_constant_folder(pyro_codegen_context& ctx)
+        : ctx_(ctx), depth_(0) { }
+
+      /**
+       * @param[in] e expression; may be null
+       * @return e with constant subexpressions replaced by literals
+       */
+      pyro_ir_expr_ptr fold(const pyro_ir_expr_ptr& e) {
+        if (!e) return e;
+        if (e->kind_ == PYRO_IR_VAR) {
+          std::map<std::string, pyro_ir_expr_ptr>::const_iterator c
+            = constants_.find(e->name_);
+          if (c == constants_.end()) return e;
+          ++ctx_.stats_.propagated_;
+          return c->second;
+        }
+        if (e->args_.empty() && e->kind_ != PYRO_IR_CALL) return e;
+        std::vector<pyro_ir_expr_ptr> args;
+        bool literals = true;
+        for (size_t i = 0; i < e->args_.size(); ++i) {
+          args.push_back(fold(e->args_[i]));
+          literals = literals && args.back() && args.back()->is_literal();
+        }
+        pyro_ir_expr_ptr r = pyro_ir_with_args(*e, args);
+        if (literals) {
+          pyro_ir_expr_ptr folded = evaluate(*r);
+          if (folded) return folded;
+        }
+        return r;
+      }
+
+      void run(std::vector<pyro_ir_stmt_ptr>& ss) {
+        for (size_t i = 0; i < ss.size(); ++i) {
+          pyro_ir_stmt& x = *ss[i];
+          if (x.kind_ == PYRO_IR_DECL) {
+            declare(std::vector<pyro_ir_stmt_ptr>(1, ss[i]));
+            continue;
+          }
+          x.lhs_ = target(x.lhs_);
+          x.rhs_ = fold(x.rhs_);
+          for (size_t j = 0; j < x.args_.size(); ++j)
+            x.args_[j] = fold(x.args_[j]);
+          if (x.kind_ == PYRO_IR_BLOCK) {
+            declare(x.decls_);
+            run(x.body_);
+          } else {
+            nested(x.body_);
+          }
+          for (size_t j = 0; j < x.bodies_.size(); ++j)
+            nested(x.bodies_[j]);
+          define(x);
+        }
+      }
+
+      void run(pyro_ir_program& ir) {
+        count_writes(ir.transformed_data_);
+        count_writes(ir.transformed_parameters_);
+        count_writes(ir.model_);
+        run(ir.transformed_data_);
+        run(ir.transformed_parameters_);
+        run(ir.model_);
+      }
+    };
+
+  }
+}
+#endif
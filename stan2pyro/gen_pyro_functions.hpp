@@ -0,0 +1,243 @@
+#ifndef STAN2PYRO_GEN_PYRO_FUNCTIONS_HPP
+#define STAN2PYRO_GEN_PYRO_FUNCTIONS_HPP
+
+#include <stan/lang/ast.hpp>
+#include <boost/unordered_map.hpp>
+#include <cctype>
+#include <string>
+#include <vector>
+
+namespace stan {
+  namespace lang {
+
+    /**
+     * Python translation of one signature of a Stan function.
+     */
+    struct pyro_function_def {
+      /**
+       * Stan function name.
+       */
+      const char* name_;
+
+      /**
+       * One character per argument:
+       *   i  int          r  real          p  int or real
+       *   v  vector       w  row vector    m  matrix
+       *   c  anything but int or real      *  any type
+       */
+      const char* signature_;
+
+      /**
+       * Python expression.  $k is replaced by argument k, #k by argument
+       * k converted to a tensor if it is an int or real, which may be a
+       * Python number at run time.
+       */
+      const char* python_;
+    };
+
+    /**
+     * Stan functions with a direct Python translation, tried in order.
+     * Functions not listed go through the run-time _call_func dispatch.
+     */
+    static const pyro_function_def pyro_function_defs[] = {
+      // elementwise
+      {"exp", "*", "torch.exp(#1)"},
+      {"log", "*", "torch.log(#1)"},
+      {"log2", "*", "torch.log2(#1)"},
+      {"log10", "*", "torch.log10(#1)"},
+      {"log1p", "*", "torch.log1p(#1)"},
+      {"expm1", "*", "torch.expm1(#1)"},
+      {"sqrt", "*", "torch.sqrt(#1)"},
+      {"inv_sqrt", "*", "torch.rsqrt(#1)"},
+      {"square", "*", "($1 ** 2)"},
+      {"inv", "*", "(1.0 / $1)"},
+      {"sin", "*", "torch.sin(#1)"},
+      {"cos", "*", "torch.cos(#1)"},
+      {"tan", "*", "torch.tan(#1)"},
+      {"sinh", "*", "torch.sinh(#1)"},
+      {"cosh", "*", "torch.cosh(#1)"},
+      {"tanh", "*", "torch.tanh(#1)"},
+      {"asin", "*", "torch.asin(#1)"},
+      {"acos", "*", "torch.acos(#1)"},
+      {"atan", "*", "torch.atan(#1)"},
+      {"floor", "*", "torch.floor(#1)"},
+      {"ceil", "*", "torch.ceil(#1)"},
+      {"round", "*", "torch.round(#1)"},
+      {"trunc", "*", "torch.trunc(#1)"},
+      {"fabs", "*", "torch.abs(#1)"},
+      {"abs", "*", "torch.abs(#1)"},
+      {"inv_logit", "*", "torch.sigmoid(#1)"},
+      {"lgamma", "*", "torch.lgamma(#1)"},
+      {"digamma", "*", "torch.digamma(#1)"},
+      {"erf", "*", "torch.erf(#1)"},
+      {"fma", "***", "($1 * $2 + $3)"},
+      {"pow", "**", "($1 ** $2)"},
+      {"fmin", "pp", "torch.min(#1, #2)"},
+      {"fmax", "pp", "torch.max(#1, #2)"},
+      // arithmetic and comparison operators parsed as functions
+      {"minus", "*", "(-$1)"},
+      {"add", "**", "($1 + $2)"},
+      {"subtract", "**", "($1 - $2)"},
+      {"multiply", "p*", "($1 * $2)"},
+      {"multiply", "*p", "($1 * $2)"},
+      {"multiply", "mm", "torch.matmul($1, $2)"},
+      {"multiply", "mv", "torch.matmul($1, $2)"},
+      {"multiply", "wm", "torch.matmul($1, $2)"},
+      {"multiply", "wv", "torch.dot($1, $2)"},
+      {"multiply", "vw", "torch.ger($1, $2)"},
+      {"divide", "ii", "_int_divide($1, $2)"},
+      {"divide", "rp", "($1 / $2)"},
+      {"divide", "pr", "($1 / $2)"},
+      {"divide", "cp", "($1 / $2)"},
+      {"elt_multiply", "**", "($1 * $2)"},
+      {"elt_divide", "**", "($1 / $2)"},
+      {"modulus", "ii", "_modulus($1, $2)"},
+      {"transpose", "c", "$1.t()"},
+      {"logical_eq", "pp", "($1 == $2)"},
+      {"logical_neq", "pp", "($1 != $2)"},
+      {"logical_lt", "pp", "($1 < $2)"},
+      {"logical_lte", "pp", "($1 <= $2)"},
+      {"logical_gt", "pp", "($1 > $2)"},
+      {"logical_gte", "pp", "($1 >= $2)"},
+      // reductions and sizes
+      {"sum", "c", "torch.sum($1)"},
+      {"prod", "c", "torch.prod($1)"},
+      {"mean", "c", "torch.mean($1)"},
+      {"sd", "c", "torch.std($1)"},
+      {"variance", "c", "torch.var($1)"},
+      {"max", "c", "torch.max($1)"},
+      {"min", "c", "torch.min($1)"},
+      {"max", "pp", "torch.max(#1, #2)"},
+      {"min", "pp", "torch.min(#1, #2)"},
+      {"log_sum_exp", "c", "torch.logsumexp($1.reshape(-1), 0)"},
+      {"log_sum_exp", "pp", "torch.logsumexp(torch.stack([#1, #2]), 0)"},
+      {"dot_product", "cc", "torch.dot($1, $2)"},
+      {"dot_self", "c", "torch.dot($1, $1)"},
+      {"rows", "v", "$1.shape[0]"},
+      {"rows", "w", "1"},
+      {"rows", "m", "$1.shape[0]"},
+      {"cols", "v", "1"},
+      {"cols", "w", "$1.shape[0]"},
+      {"cols", "m", "$1.shape[1]"},
+      {"num_elements", "c", "$1.numel()"},
+      {"size", "c", "len($1)"}
+    };
+
+    /**
+     * @param[in] c signature character
+     * @param[in] t argument type
+     * @return true if the argument type matches the character
+     */
+    bool pyro_matches_signature(char c, const expr_type& t) {
+      switch (c) {
+        case 'i': return t.is_primitive_int();
+        case 'r': return t.is_primitive_double();
+        case 'p': return t.is_primitive();
+        case 'v': return t.num_dims_ == 0 && t.base_type_.is_vector_type();
+        case 'w': return t.num_dims_ == 0 && t.base_type_.is_row_vector_type();
+        case 'm': return t.num_dims_ == 0 && t.base_type_.is_matrix_type();
+        case 'c': return !t.is_primitive();
+        default: return true;
+      }
+    }
+
+    /**
+     * @param[in] sig signature, one character per argument
+     * @param[in] args argument types of a call
+     * @return true if the argument types match the signature
+     */
+    bool pyro_matches_signature(const std::string& sig,
+                                const std::vector<expr_type>& args) {
+      if (sig.size() != args.size()) return false;
+      for (size_t k = 0; k < sig.size(); ++k)
+        if (!pyro_matches_signature(sig[k], args[k]))
+          return false;
+      return true;
+    }
+
+    /**
+     * Registry of the Python translations of Stan functions, indexed by
+     * name once per process.
+     */
+    class pyro_function_registry {
+      boost::unordered_map<std::string, std::vector<const pyro_function_def*> > defs_;
+
+      pyro_function_registry() {
+        size_t n = sizeof(pyro_function_defs) / sizeof(pyro_function_defs[0]);
+        for (size_t i = 0; i < n; ++i)
+          defs_[pyro_function_defs[i].name_].push_back(&pyro_function_defs[i]);
+      }
+
+    public:
+      static const pyro_function_registry& instance() {
+        static const pyro_function_registry registry;
+        return registry;
+      }
+
+      /**
+       * @param[in] name Stan function name
+       * @param[in] args argument types of the call
+       * @return translation of the first signature matching the
+       * argument types, or null if there is none
+       */
+      const pyro_function_def* find(const std::string& name,
+                                    const std::vector<expr_type>& args) const {
+        boost::unordered_map<std::string, std::vector<const pyro_function_def*> >
+          ::const_iterator it = defs_.find(name);
+        if (it == defs_.end()) return 0;
+        for (size_t i = 0; i < it->second.size(); ++i)
+          if (pyro_matches_signature(it->second[i]->signature_, args))
+            return it->second[i];
+        return 0;
+      }
+    };
+
+    /**
+     * @param[in] def translation
+     * @param[in] args argument types of the call
+     * @return true if the translation is a torch function of tensors,
+     * ints and reals converted to tensors included, which returns
+     * inf or nan where Python arithmetic on numbers would raise
+     */
+    bool pyro_is_tensor_function(const pyro_function_def& def,
+                                 const std::vector<expr_type>& args) {
+      std::string python(def.python_);
+      if (python.compare(0, 6, "torch.") != 0) return false;
+      for (size_t i = 0; i + 1 < python.size(); ++i)
+        if (python[i] == '$' && std::isdigit(python[i + 1])
+            && args[python[i + 1] - '1'].is_primitive())
+          return false;
+      return true;
+    }
+
+    /**
+     * Expand the Python translation of a call.
+     *
+     * @param[in] python translation, with $k and #k placeholders (see
+     * pyro_function_def)
+     * @param[in] args argument types of the call
+     * @param[in] py_args generated Python of each argument
+     * @return Python expression of the call
+     */
+    std::string pyro_expand_function(const char* python,
+                                     const std::vector<expr_type>& args,
+                                     const std::vector<std::string>& py_args) {
+      std::string out;
+      for (const char* c = python; *c; ++c) {
+        if ((*c == '$' || *c == '#') && std::isdigit(*(c + 1))) {
+          size_t k = *(c + 1) - '1';
+          if (*c == '#' && args[k].is_primitive())
+            out += "_as_tensor(" + py_args[k] + ")";
+          else
+            out += py_args[k];
+          ++c;
+        } else {
+          out += *c;
+        }
+      }
+      return out;
+    }
+
+  }
+}
+#endif
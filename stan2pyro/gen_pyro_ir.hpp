@@ -0,0 +1,542 @@
+#ifndef STAN2PYRO_GEN_PYRO_IR_HPP
+#define STAN2PYRO_GEN_PYRO_IR_HPP
+
+#include <stan/lang/ast.hpp>
+#include <gen_pyro_symbols.hpp>
+#include <boost/lexical_cast.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace stan {
+  namespace lang {
+
+    /**
+     * Intermediate representation between the Stan AST and the generated
+     * Python.  Statements of the transformed data, transformed
+     * parameters and model blocks are lowered to a tree of typed nodes
+     * (see gen_pyro_lower.hpp), rewritten by optimization passes such as
+     * gen_pyro_vectorize.hpp, and printed as Python by
+     * gen_pyro_printer.hpp.  Passes inspect and rebuild nodes; none of
+     * them looks at generated text.
+     *
+     * Expressions are immutable and may share subtrees; passes build new
+     * nodes instead of modifying old ones.  Statements are owned by their
+     * parent and are rewritten in place.
+     */
+
+    struct pyro_ir_expr;
+    struct pyro_ir_stmt;
+
+    typedef std::shared_ptr<const pyro_ir_expr> pyro_ir_expr_ptr;
+    typedef std::shared_ptr<pyro_ir_stmt> pyro_ir_stmt_ptr;
+
+    /**
+     * Element type of a value.
+     */
+    enum pyro_ir_dtype {
+      PYRO_IR_INT,
+      PYRO_IR_REAL,
+      /**
+       * Void, ill-formed, or unknown.
+       */
+      PYRO_IR_NO_DTYPE
+    };
+
+    /**
+     * Type of a value: its Stan type, which fixes the element type and
+     * rank, and its extent along each dimension when known.
+     */
+    struct pyro_ir_type {
+      /**
+       * Stan type: int or real base, array dimensions, and whether the
+       * base is a vector, row vector or matrix.
+       */
+      expr_type stan_;
+
+      /**
+       * Extent of each dimension, array dimensions first, as expressions
+       * evaluated in the generated function; empty if unknown.
+       */
+      std::vector<pyro_ir_expr_ptr> extents_;
+
+      /**
+       * True once pyro_shape_inference has found the shape of the value
+       * at run time: then extents_ has one extent per tensor dimension.
+       * Values computed by a vectorized loop have the dimension of the
+       * slice on top of their Stan type.
+       */
+      bool shaped_;
+
+      pyro_ir_type() : shaped_(false) { }
+
+      explicit pyro_ir_type(const expr_type& stan) : stan_(stan), shaped_(false) { }
+
+      pyro_ir_dtype dtype() const {
+        if (stan_.base_type_.is_int_type()) return PYRO_IR_INT;
+        if (stan_.base_type_.is_void_type() || stan_.base_type_.is_ill_formed_type())
+          return PYRO_IR_NO_DTYPE;
+        return PYRO_IR_REAL;
+      }
+
+      /**
+       * @return number of tensor dimensions
+       */
+      size_t rank() const {
+        if (stan_.base_type_.is_vector_type() || stan_.base_type_.is_row_vector_type())
+          return stan_.num_dims_ + 1;
+        if (stan_.base_type_.is_matrix_type())
+          return stan_.num_dims_ + 2;
+        return stan_.num_dims_;
+      }
+
+      /**
+       * @return true for an int or real, which may be a Python number at
+       * run time
+       */
+      bool is_scalar() const {
+        return stan_.is_primitive();
+      }
+
+      /**
+       * @return true if the extent of every dimension is known
+       */
+      bool has_extents() const {
+        return extents_.size() == rank();
+      }
+    };
+
+    /**
+     * @param[in] t type of an indexed value
+     * @param[in] n number of single indexes applied to it
+     * @return type of the element
+     */
+    expr_type pyro_ir_index_type(const expr_type& t, size_t n) {
+      if (n <= t.num_dims_)
+        return expr_type(t.base_type_, t.num_dims_ - n);
+      size_t rest = n - t.num_dims_;
+      if (t.base_type_.is_matrix_type() && rest == 1)
+        return expr_type(base_expr_type(row_vector_type()), 0);
+      return expr_type(base_expr_type(double_type()), 0);
+    }
+
+    enum pyro_ir_expr_kind {
+      /**
+       * Int or real constant; text_ is its spelling, value_ its value.
+       */
+      PYRO_IR_LITERAL,
+      /**
+       * Variable name_; text_ is its Python name, block_ where it is
+       * declared.
+       */
+      PYRO_IR_VAR,
+      /**
+       * args_[0] indexed by the 1-based indexes args_[1..], one per
+       * dimension from the first: single int indexes, which drop their
+       * dimension, int arrays, which gather along it, and ranges.
+       */
+      PYRO_IR_INDEX,
+      /**
+       * The elements [args_[1], args_[2]) of args_[0], as a 0-based
+       * half-open Python slice.
+       */
+      PYRO_IR_SLICE,
+      /**
+       * Index of a PYRO_IR_INDEX keeping the elements args_[0] to
+       * args_[1] of its dimension, 1-based and inclusive; a null bound
+       * stands for the first or last element.
+       */
+      PYRO_IR_RANGE,
+      /**
+       * Stan function name_ applied to args_.
+       */
+      PYRO_IR_CALL,
+      /**
+       * Infix operator name_ applied to args_[0] and args_[1].
+       */
+      PYRO_IR_BINARY,
+      /**
+       * Prefix operator name_ applied to args_[0].
+       */
+      PYRO_IR_UNARY,
+      /**
+       * args_[1] if args_[0] holds, otherwise args_[2].
+       */
+      PYRO_IR_CONDITIONAL,
+      /**
+       * Function name_ of the Python run time (to_int, max, ...) applied
+       * to args_.
+       */
+      PYRO_IR_PYTHON
+    };
+
+    /**
+     * Expression node.  A null pointer stands for an absent expression,
+     * such as a missing bound.
+     */
+    struct pyro_ir_expr {
+      pyro_ir_expr_kind kind_;
+
+      /**
+       * Variable, function or operator name, by kind.
+       */
+      std::string name_;
+
+      /**
+       * Spelling of a literal or Python name of a variable.
+       */
+      std::string text_;
+
+      /**
+       * Value of a literal.
+       */
+      double value_;
+
+      /**
+       * Block declaring a variable.
+       */
+      pyro_block block_;
+
+      /**
+       * True for a call of a function from the functions block.
+       */
+      bool user_defined_;
+
+      /**
+       * True for an index whose single indexes are all proven within
+       * their dimensions (see pyro_bounds_analysis).
+       */
+      bool in_bounds_;
+
+      /**
+       * Operands, by kind.
+       */
+      std::vector<pyro_ir_expr_ptr> args_;
+
+      pyro_ir_type type_;
+
+      explicit pyro_ir_expr(pyro_ir_expr_kind kind)
+        : kind_(kind), value_(0), block_(PYRO_LOCAL_BLOCK), user_defined_(false),
+          in_bounds_(false) { }
+
+      bool is_literal() const { return kind_ == PYRO_IR_LITERAL; }
+
+      bool is_int_literal() const {
+        return kind_ == PYRO_IR_LITERAL && type_.dtype() == PYRO_IR_INT;
+      }
+
+      /**
+       * @param[in] name Stan identifier
+       * @return true if this is the variable
+       */
+      bool is_var(const std::string& name) const {
+        return kind_ == PYRO_IR_VAR && name_ == name;
+      }
+    };
+
+    pyro_ir_expr_ptr pyro_ir_int(long n) {
+      std::shared_ptr<pyro_ir_expr> e(new pyro_ir_expr(PYRO_IR_LITERAL));
+      e->text_ = boost::lexical_cast<std::string>(n);
+      e->value_ = n;
+      e->type_ = pyro_ir_type(expr_type(base_expr_type(int_type()), 0));
+      return e;
+    }
+
+    pyro_ir_expr_ptr pyro_ir_real(double x) {
+      std::shared_ptr<pyro_ir_expr> e(new pyro_ir_expr(PYRO_IR_LITERAL));
+      e->text_ = boost::lexical_cast<std::string>(x);
+      if (e->text_.find_first_of("eE.") == std::string::npos)
+        e->text_ += ".0";  // so that Python makes it a float
+      e->value_ = x;
+      e->type_ = pyro_ir_type(expr_type(base_expr_type(double_type()), 0));
+      return e;
+    }
+
+    /**
+     * @param[in] op operator, or function or Python function name
+     * @param[in] args operands
+     * @param[in] type type of the result
+     * @return new node of the specified kind
+     */
+    pyro_ir_expr_ptr pyro_ir_node(pyro_ir_expr_kind kind, const std::string& name,
+                                  const std::vector<pyro_ir_expr_ptr>& args,
+                                  const pyro_ir_type& type) {
+      std::shared_ptr<pyro_ir_expr> e(new pyro_ir_expr(kind));
+      e->name_ = name;
+      e->args_ = args;
+      e->type_ = type;
+      return e;
+    }
+
+    pyro_ir_expr_ptr pyro_ir_binary(const std::string& op, const pyro_ir_expr_ptr& a,
+                                    const pyro_ir_expr_ptr& b, const pyro_ir_type& type) {
+      std::vector<pyro_ir_expr_ptr> args;
+      args.push_back(a);
+      args.push_back(b);
+      return pyro_ir_node(PYRO_IR_BINARY, op, args, type);
+    }
+
+    /**
+     * @return call of a Python run-time function of ints
+     */
+    pyro_ir_expr_ptr pyro_ir_python(const std::string& name,
+                                    const std::vector<pyro_ir_expr_ptr>& args) {
+      return pyro_ir_node(PYRO_IR_PYTHON, name, args,
+                          pyro_ir_type(expr_type(base_expr_type(int_type()), 0)));
+    }
+
+    pyro_ir_expr_ptr pyro_ir_python(const std::string& name, const pyro_ir_expr_ptr& a) {
+      return pyro_ir_python(name, std::vector<pyro_ir_expr_ptr>(1, a));
+    }
+
+    /**
+     * @return copy of e with the operands replaced by args
+     */
+    pyro_ir_expr_ptr pyro_ir_with_args(const pyro_ir_expr& e,
+                                       const std::vector<pyro_ir_expr_ptr>& args) {
+      std::shared_ptr<pyro_ir_expr> r(new pyro_ir_expr(e));
+      r->args_ = args;
+      return r;
+    }
+
+    /**
+     * @return Stan types of the expressions
+     */
+    std::vector<expr_type> pyro_ir_types(const std::vector<pyro_ir_expr_ptr>& es) {
+      std::vector<expr_type> types;
+      for (size_t i = 0; i < es.size(); ++i)
+        types.push_back(es[i] ? es[i]->type_.stan_ : expr_type());
+      return types;
+    }
+
+    /**
+     * @param[in] a expression; may be null
+     * @param[in] b expression; may be null
+     * @return true if a and b compute the same thing the same way
+     */
+    bool pyro_ir_equal(const pyro_ir_expr_ptr& a, const pyro_ir_expr_ptr& b) {
+      if (a == b) return true;
+      if (!a || !b) return false;
+      if (a->kind_ != b->kind_ || a->name_ != b->name_ || a->text_ != b->text_
+          || a->user_defined_ != b->user_defined_
+          || a->type_.dtype() != b->type_.dtype() || a->type_.rank() != b->type_.rank()
+          || a->args_.size() != b->args_.size())
+        return false;
+      for (size_t i = 0; i < a->args_.size(); ++i)
+        if (!pyro_ir_equal(a->args_[i], b->args_[i])) return false;
+      return true;
+    }
+
+    /**
+     * @param[in] a extent; may be null
+     * @param[in] b extent; may be null
+     * @return true if a and b are known to be the same extent, taking
+     * to_int(n) to be n
+     */
+    bool pyro_ir_same_extent(pyro_ir_expr_ptr a, pyro_ir_expr_ptr b) {
+      while (a && a->kind_ == PYRO_IR_PYTHON && a->name_ == "to_int") a = a->args_[0];
+      while (b && b->kind_ == PYRO_IR_PYTHON && b->name_ == "to_int") b = b->args_[0];
+      if (!a || !b) return false;
+      if (a->is_literal() && b->is_literal()) return a->value_ == b->value_;
+      if (a->kind_ != b->kind_ || a->name_ != b->name_ || a->text_ != b->text_
+          || a->args_.size() != b->args_.size())
+        return false;
+      for (size_t i = 0; i < a->args_.size(); ++i)
+        if (!pyro_ir_same_extent(a->args_[i], b->args_[i])) return false;
+      return true;
+    }
+
+    /**
+     * @return true if values of types a and b are known to have the same
+     * shape at run time
+     */
+    bool pyro_ir_same_shape(const pyro_ir_type& a, const pyro_ir_type& b) {
+      if (!a.shaped_ || !b.shaped_ || a.extents_.size() != b.extents_.size())
+        return false;
+      for (size_t i = 0; i < a.extents_.size(); ++i)
+        if (!pyro_ir_same_extent(a.extents_[i], b.extents_[i])) return false;
+      return true;
+    }
+
+    /**
+     * @param[in] e expression; may be null
+     * @param[in] name Stan identifier
+     * @return true if the expression reads the variable
+     */
+    bool pyro_ir_uses(const pyro_ir_expr_ptr& e, const std::string& name) {
+      if (!e) return false;
+      if (e->is_var(name)) return true;
+      for (size_t i = 0; i < e->args_.size(); ++i)
+        if (pyro_ir_uses(e->args_[i], name)) return true;
+      return false;
+    }
+
+    /**
+     * @param[in] e expression, a variable or an element or slice of one;
+     * may be null
+     * @return the variable, or null if there is none
+     */
+    const pyro_ir_expr* pyro_ir_base_var(const pyro_ir_expr_ptr& e) {
+      if (!e) return 0;
+      if (e->kind_ == PYRO_IR_VAR) return e.get();
+      if (e->kind_ == PYRO_IR_INDEX || e->kind_ == PYRO_IR_SLICE)
+        return pyro_ir_base_var(e->args_[0]);
+      return 0;
+    }
+
+    enum pyro_ir_stmt_kind {
+      /**
+       * Declaration of lhs_, a variable, with the Python initialization
+       * text_, which reads the expressions args_: the extents, then the
+       * bounds.
+       */
+      PYRO_IR_DECL,
+      /**
+       * lhs_ = rhs_, for a variable or an element or slice of one.
+       */
+      PYRO_IR_ASSIGN,
+      /**
+       * lhs_ = rhs_, the only assignment of lhs_, a compiler temporary
+       * (see pyro_temporary_name).
+       */
+      PYRO_IR_LET,
+      /**
+       * lhs_ ~ name_(args_); observed if lhs_ is data.
+       */
+      PYRO_IR_SAMPLE,
+      /**
+       * target += rhs_, added to the Python accumulator text_ (see
+       * pyro_target_accumulation).
+       */
+      PYRO_IR_FACTOR,
+      /**
+       * rhs_ evaluated for its side effects.
+       */
+      PYRO_IR_EXPR,
+      /**
+       * for (name_ in args_[0]:args_[1]) body_, with inclusive bounds;
+       * if zero_based_, name_ runs from args_[0] - 1 to args_[1] - 1.
+       */
+      PYRO_IR_FOR,
+      /**
+       * while (rhs_) body_.
+       */
+      PYRO_IR_WHILE,
+      /**
+       * body_ in pyro.plate name_ of size args_[0]; with args_[1], in
+       * mini-batches of that size, whose 0-based positions the body
+       * reads from the variable lhs_.
+       */
+      PYRO_IR_PLATE,
+      /**
+       * if (args_[0]) bodies_[0] else if (args_[1]) bodies_[1] ...,
+       * with a final else branch if bodies_ has one more entry.
+       */
+      PYRO_IR_IF,
+      /**
+       * Local declarations decls_ followed by body_.
+       */
+      PYRO_IR_BLOCK,
+      /**
+       * Python text_, emitted as is (break, continue, the target
+       * accumulator and its factor).
+       */
+      PYRO_IR_VERBATIM
+    };
+
+    /**
+     * Statement node.
+     */
+    struct pyro_ir_stmt {
+      pyro_ir_stmt_kind kind_;
+
+      /**
+       * Program block of the statement.
+       */
+      pyro_block block_;
+
+      /**
+       * First line of the Stan statement, or 0.
+       */
+      size_t line_;
+
+      /**
+       * Loop variable, plate, or distribution family, by kind.
+       */
+      std::string name_;
+
+      /**
+       * Python text, by kind.
+       */
+      std::string text_;
+
+      pyro_ir_expr_ptr lhs_;
+
+      pyro_ir_expr_ptr rhs_;
+
+      /**
+       * Loop bounds, plate size, conditions or distribution arguments,
+       * by kind.
+       */
+      std::vector<pyro_ir_expr_ptr> args_;
+
+      /**
+       * True for a truncated sampling statement.
+       */
+      bool truncated_;
+
+      /**
+       * True for a for loop whose variable holds the 0-based index,
+       * which the body reads as name_ + 1 (see pyro_zero_based_loops).
+       */
+      bool zero_based_;
+
+      /**
+       * True for the sample of a discrete latent variable that Pyro
+       * enumerates in parallel, whose lhs_ is a compiler temporary
+       * holding the 1-based category (see pyro_mixture_enumeration).
+       */
+      bool enumerated_;
+
+      std::vector<pyro_ir_stmt_ptr> decls_;
+
+      std::vector<pyro_ir_stmt_ptr> body_;
+
+      std::vector<std::vector<pyro_ir_stmt_ptr> > bodies_;
+
+      pyro_ir_stmt(pyro_ir_stmt_kind kind, pyro_block block, size_t line)
+        : kind_(kind), block_(block), line_(line), truncated_(false), zero_based_(false),
+          enumerated_(false) { }
+    };
+
+    /**
+     * Lowered program: the statements of the generated functions that
+     * come from Stan statements, declarations first.
+     */
+    struct pyro_ir_program {
+      /**
+       * Declarations of the parameters, which init_params prints from
+       * the Stan program; kept for the variables their extents and
+       * bounds read.
+       */
+      std::vector<pyro_ir_stmt_ptr> parameters_;
+
+      /**
+       * Body of transformed_data(data).
+       */
+      std::vector<pyro_ir_stmt_ptr> transformed_data_;
+
+      /**
+       * Transformed parameters part of model(data, params).
+       */
+      std::vector<pyro_ir_stmt_ptr> transformed_parameters_;
+
+      /**
+       * Model block part of model(data, params).
+       */
+      std::vector<pyro_ir_stmt_ptr> model_;
+    };
+
+  }
+}
+#endif
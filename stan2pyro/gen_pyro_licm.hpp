@@ -0,0 +1,295 @@
+#ifndef STAN2PYRO_GEN_PYRO_LICM_HPP
+#define STAN2PYRO_GEN_PYRO_LICM_HPP
+
+#include <stan/lang/ast.hpp>
+#include <gen_pyro_context.hpp>
+#include <gen_pyro_ir.hpp>
+#include <gen_pyro_functions.hpp>
+#include <gen_pyro_vectorize.hpp>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace stan {
+  namespace lang {
+
+    /**
+     * @param[in] e expression; may be null
+     * @return true if evaluating e cannot fail or have side effects, so
+     * that it may run before a loop that would not have run it at all
+     */
+    bool is_pyro_hoistable(const pyro_ir_expr_ptr& e) {
+      if (!e) return true;
+      switch (e->kind_) {
+        case PYRO_IR_LITERAL:
+        case PYRO_IR_VAR:
+          break;
+        case PYRO_IR_INDEX:
+        case PYRO_IR_SLICE:
+          // may be out of range when the loop does not run
+          return false;
+        case PYRO_IR_RANGE:
+          // not a value; its bounds may move
+          return false;
+        case PYRO_IR_CALL: {
+          if (e->user_defined_ || has_rng_suffix(e->name_) || has_lp_suffix(e->name_))
+            return false;
+          // Python arithmetic on numbers, as in inv(s) or s ^ t, raises
+          // on a zero division, and _call_func may assert
+          std::vector<expr_type> types = pyro_ir_types(e->args_);
+          const pyro_function_def* def
+            = pyro_function_registry::instance().find(e->name_, types);
+          if (!def || !pyro_is_tensor_function(*def, types))
+            return false;
+          break;
+        }
+        case PYRO_IR_BINARY:
+          // Python numbers raise on division by zero
+          if ((e->name_ == "/" || e->name_ == "%")
+              && !(e->args_[1]->is_literal() && e->args_[1]->value_ != 0))
+            return false;
+          break;
+        case PYRO_IR_UNARY:
+        case PYRO_IR_CONDITIONAL:
+        case PYRO_IR_PYTHON:
+          break;
+      }
+      for (size_t i = 0; i < e->args_.size(); ++i)
+        if (!is_pyro_hoistable(e->args_[i])) return false;
+      return true;
+    }
+
+    /**
+     * Loop-invariant code motion.  Each for and while loop gets a
+     * preheader, statements run just before it, holding
+     *
+     *  - the invariant subexpressions of its body, each computed once
+     *    into a compiler temporary that the body reads instead;
+     *  - the declarations of its local tensors, when their extents and
+     *    bounds are invariant and the body only ever assigns them whole,
+     *    so that no iteration sees an element left by the previous one.
+     *
+     * Loops are processed innermost first, so a temporary hoisted out of
+     * an inner loop moves further out while it stays invariant.
+     *
+     *   for (n in 1:N) x[n] ~ normal(mu[n], sqrt(sigma_sq));
+     *
+     *   _t1__ = torch.sqrt(_as_tensor(sigma_sq))
+     *   for n in range(1, to_int(N) + 1):
+     *       x[n - 1] =  pyro.sample(..., dist.Normal(mu[n - 1], _t1__) ...
+     *
+     * A preheader runs even if the loop does not, so only expressions
+     * that cannot fail or have side effects move (see
+     * is_pyro_hoistable), and nothing moves out of the branches of a
+     * conditional, whose guard may be what keeps them from failing:
+     *
+     *   for (n in 1:N) if (s != 0) y[n] ~ normal(0, inv(s));
+     *
+     * This holds for every expression of a branch, even one that is safe
+     * to hoist: a branch gets no preheader of its own, so a straight-line
+     * invariant in a guarded body is still computed on each iteration.
+     * Only loops nested in the branch have their invariants hoisted, to
+     * just before the inner loop.
+     */
+    class pyro_loop_invariant_motion {
+      pyro_codegen_context& ctx_;
+
+      /**
+       * Statements of the preheader being built.
+       */
+      std::vector<pyro_ir_stmt_ptr> preheader_;
+
+      /**
+       * Variables written by the loop being processed, its own variable
+       * included.
+       */
+      std::set<std::string> written_;
+
+      /**
+       * Variables the loop assigns as a whole, and those of which it
+       * assigns an element or slice.
+       */
+      std::set<std::string> assigned_whole_, assigned_part_;
+
+      void collect_writes(const std::vector<pyro_ir_stmt_ptr>& ss) {
+        for (size_t i = 0; i < ss.size(); ++i) {
+          const pyro_ir_stmt& x = *ss[i];
+          if (x.kind_ == PYRO_IR_ASSIGN || x.kind_ == PYRO_IR_SAMPLE
+              || x.kind_ == PYRO_IR_LET) {
+            if (const pyro_ir_expr* v = pyro_ir_base_var(x.lhs_)) {
+              written_.insert(v->name_);
+              (x.lhs_->kind_ == PYRO_IR_VAR ? assigned_whole_ : assigned_part_)
+                .insert(v->name_);
+            }
+          }
+          if (x.kind_ == PYRO_IR_DECL) written_.insert(x.lhs_->name_);
+          if (x.kind_ == PYRO_IR_FOR) written_.insert(x.name_);
+          // the positions of a mini-batch, bound by its plate
+          if (x.kind_ == PYRO_IR_PLATE && x.lhs_) written_.insert(x.lhs_->name_);
+          collect_writes(x.decls_);
+          collect_writes(x.body_);
+          for (size_t j = 0; j < x.bodies_.size(); ++j)
+            collect_writes(x.bodies_[j]);
+        }
+      }
+
+      bool invariant(const pyro_ir_expr_ptr& e) const {
+        pyro_loop_dependence_analysis dep("", written_);
+        return dep.dep(e) == PYRO_LOOP_INVARIANT;
+      }
+
+      bool movable(const pyro_ir_expr_ptr& e) const {
+        return invariant(e) && is_pyro_hoistable(e);
+      }
+
+      /**
+       * Move the temporaries of inner loops whose value is invariant in
+       * this one to the preheader.
+       */
+      void hoist_lets(std::vector<pyro_ir_stmt_ptr>& ss) {
+        std::vector<pyro_ir_stmt_ptr> out;
+        for (size_t i = 0; i < ss.size(); ++i) {
+          pyro_ir_stmt& x = *ss[i];
+          if (x.kind_ == PYRO_IR_LET) {
+            written_.erase(x.lhs_->name_);
+            if (movable(x.rhs_)) {
+              preheader_.push_back(ss[i]);
+              ++ctx_.stats_.hoisted_;
+              continue;
+            }
+            written_.insert(x.lhs_->name_);
+          }
+          hoist_lets(x.body_);
+          out.push_back(ss[i]);
+        }
+        ss.swap(out);
+      }
+
+      bool movable_decl(const pyro_ir_stmt& d) const {
+        if (d.lhs_->type_.rank() == 0 || assigned_part_.count(d.lhs_->name_))
+          return false;
+        for (size_t i = 0; i < d.args_.size(); ++i)
+          if (!movable(d.args_[i])) return false;
+        return true;
+      }
+
+      void hoist_decls(std::vector<pyro_ir_stmt_ptr>& ss) {
+        std::vector<pyro_ir_stmt_ptr> out;
+        for (size_t i = 0; i < ss.size(); ++i) {
+          pyro_ir_stmt& x = *ss[i];
+          if (x.kind_ == PYRO_IR_DECL && movable_decl(x)) {
+            preheader_.push_back(ss[i]);
+            ++ctx_.stats_.hoisted_;
+            if (!assigned_whole_.count(x.lhs_->name_))
+              written_.erase(x.lhs_->name_);
+            continue;
+          }
+          hoist_decls(x.decls_);
+          hoist_decls(x.body_);
+          out.push_back(ss[i]);
+        }
+        ss.swap(out);
+      }
+
+      /**
+       * @return e with its largest invariant subexpressions replaced by
+       * temporaries computed in the preheader
+       */
+      pyro_ir_expr_ptr hoist(const pyro_ir_expr_ptr& e) {
+        if (!e || e->kind_ == PYRO_IR_LITERAL || e->kind_ == PYRO_IR_VAR) return e;
+        if (movable(e)) {
+          for (size_t i = 0; i < preheader_.size(); ++i)
+            if (preheader_[i]->kind_ == PYRO_IR_LET && pyro_ir_equal(preheader_[i]->rhs_, e))
+              return preheader_[i]->lhs_;
+          std::shared_ptr<pyro_ir_expr> t(new pyro_ir_expr(PYRO_IR_VAR));
+          t->name_ = t->text_ = ctx_.temporary();
+          t->type_ = e->type_;
+          pyro_ir_stmt_ptr let(new pyro_ir_stmt(PYRO_IR_LET, PYRO_LOCAL_BLOCK, 0));
+          let->lhs_ = t;
+          let->rhs_ = e;
+          preheader_.push_back(let);
+          ++ctx_.stats_.hoisted_;
+          return t;
+        }
+        std::vector<pyro_ir_expr_ptr> args;
+        for (size_t i = 0; i < e->args_.size(); ++i)
+          args.push_back(hoist(e->args_[i]));
+        return pyro_ir_with_args(*e, args);
+      }
+
+      /**
+       * Hoist from the indexes of an assignment or sampling target.
+       */
+      pyro_ir_expr_ptr hoist_target(const pyro_ir_expr_ptr& e) {
+        if (!e || e->kind_ == PYRO_IR_VAR) return e;
+        if (e->kind_ != PYRO_IR_INDEX && e->kind_ != PYRO_IR_SLICE) return hoist(e);
+        std::vector<pyro_ir_expr_ptr> args(1, hoist_target(e->args_[0]));
+        for (size_t i = 1; i < e->args_.size(); ++i)
+          args.push_back(hoist(e->args_[i]));
+        return pyro_ir_with_args(*e, args);
+      }
+
+      void hoist_exprs(std::vector<pyro_ir_stmt_ptr>& ss) {
+        for (size_t i = 0; i < ss.size(); ++i) {
+          pyro_ir_stmt& x = *ss[i];
+          // declarations print their initialization from text
+          if (x.kind_ == PYRO_IR_DECL) continue;
+          // only the first condition of an if runs on every iteration
+          if (x.kind_ == PYRO_IR_IF) {
+            x.args_[0] = hoist(x.args_[0]);
+            continue;
+          }
+          x.lhs_ = hoist_target(x.lhs_);
+          x.rhs_ = hoist(x.rhs_);
+          for (size_t j = 0; j < x.args_.size(); ++j)
+            x.args_[j] = hoist(x.args_[j]);
+          hoist_exprs(x.body_);
+        }
+      }
+
+      /**
+       * Build the preheader of loop x.
+       */
+      void hoist_loop(pyro_ir_stmt& x) {
+        preheader_.clear();
+        written_.clear();
+        assigned_whole_.clear();
+        assigned_part_.clear();
+        if (x.kind_ == PYRO_IR_FOR) written_.insert(x.name_);
+        collect_writes(x.body_);
+        hoist_lets(x.body_);
+        hoist_decls(x.body_);
+        if (x.kind_ == PYRO_IR_WHILE) x.rhs_ = hoist(x.rhs_);
+        hoist_exprs(x.body_);
+      }
+
+    public:
+      explicit pyro_loop_invariant_motion(pyro_codegen_context& ctx)
+        : ctx_(ctx) { }
+
+      void run(std::vector<pyro_ir_stmt_ptr>& ss) {
+        std::vector<pyro_ir_stmt_ptr> out;
+        for (size_t i = 0; i < ss.size(); ++i) {
+          pyro_ir_stmt& x = *ss[i];
+          run(x.body_);
+          for (size_t j = 0; j < x.bodies_.size(); ++j)
+            run(x.bodies_[j]);
+          if (x.kind_ == PYRO_IR_FOR || x.kind_ == PYRO_IR_WHILE) {
+            hoist_loop(x);
+            out.insert(out.end(), preheader_.begin(), preheader_.end());
+          }
+          out.push_back(ss[i]);
+        }
+        ss.swap(out);
+      }
+
+      void run(pyro_ir_program& ir) {
+        run(ir.transformed_data_);
+        run(ir.transformed_parameters_);
+        run(ir.model_);
+      }
+    };
+
+  }
+}
+#endif
@@ -0,0 +1,631 @@
+#ifndef STAN2PYRO_GEN_PYRO_LOWER_HPP
+#define STAN2PYRO_GEN_PYRO_LOWER_HPP
+
+#include <stan/lang/ast.hpp>
+#include <gen_pyro_context.hpp>
+#include <gen_pyro_ir.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/variant/apply_visitor.hpp>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace stan {
+  namespace lang {
+
+    void generate_var_init_python(const var_decl& v, int indent,
+                                  const pyro_codegen_context& ctx, std::ostream& o);
+
+    /**
+     * Visitor returning the extent of each dimension of a declared
+     * variable, array dimensions first.
+     */
+    struct pyro_decl_extents_vis
+      : public boost::static_visitor<std::vector<expression> > {
+      std::vector<expression> operator()(const nil& /*x*/) const {
+        return std::vector<expression>();
+      }
+
+      std::vector<expression> operator()(const int_var_decl& x) const {
+        return x.dims_;
+      }
+
+      std::vector<expression> operator()(const double_var_decl& x) const {
+        return x.dims_;
+      }
+
+      std::vector<expression> operator()(const vector_var_decl& x) const {
+        return append(x.dims_, x.M_);
+      }
+
+      std::vector<expression> operator()(const row_vector_var_decl& x) const {
+        return append(x.dims_, x.N_);
+      }
+
+      std::vector<expression> operator()(const matrix_var_decl& x) const {
+        return append(append(x.dims_, x.M_), x.N_);
+      }
+
+      std::vector<expression> operator()(const simplex_var_decl& x) const {
+        return append(x.dims_, x.K_);
+      }
+
+      std::vector<expression> operator()(const unit_vector_var_decl& x) const {
+        return append(x.dims_, x.K_);
+      }
+
+      std::vector<expression> operator()(const ordered_var_decl& x) const {
+        return append(x.dims_, x.K_);
+      }
+
+      std::vector<expression> operator()(const positive_ordered_var_decl& x) const {
+        return append(x.dims_, x.K_);
+      }
+
+      std::vector<expression> operator()(const cholesky_factor_var_decl& x) const {
+        return append(append(x.dims_, x.M_), x.N_);
+      }
+
+      std::vector<expression> operator()(const cholesky_corr_var_decl& x) const {
+        return append(append(x.dims_, x.K_), x.K_);
+      }
+
+      std::vector<expression> operator()(const cov_matrix_var_decl& x) const {
+        return append(append(x.dims_, x.K_), x.K_);
+      }
+
+      std::vector<expression> operator()(const corr_matrix_var_decl& x) const {
+        return append(append(x.dims_, x.K_), x.K_);
+      }
+
+      static std::vector<expression> append(std::vector<expression> es,
+                                            const expression& e) {
+        es.push_back(e);
+        return es;
+      }
+    };
+
+    /**
+     * Visitor returning the lower and upper bounds of a declared
+     * variable that has them.
+     */
+    struct pyro_decl_bounds_vis
+      : public boost::static_visitor<std::vector<expression> > {
+      template <typename D>
+      std::vector<expression> operator()(const D& /*x*/) const {
+        return std::vector<expression>();
+      }
+
+      std::vector<expression> operator()(const int_var_decl& x) const {
+        return bounds(x.range_);
+      }
+
+      std::vector<expression> operator()(const double_var_decl& x) const {
+        return bounds(x.range_);
+      }
+
+      std::vector<expression> operator()(const vector_var_decl& x) const {
+        return bounds(x.range_);
+      }
+
+      std::vector<expression> operator()(const row_vector_var_decl& x) const {
+        return bounds(x.range_);
+      }
+
+      std::vector<expression> operator()(const matrix_var_decl& x) const {
+        return bounds(x.range_);
+      }
+
+      static std::vector<expression> bounds(const range& r) {
+        std::vector<expression> es;
+        if (r.has_low()) es.push_back(r.low_);
+        if (r.has_high()) es.push_back(r.high_);
+        return es;
+      }
+    };
+
+    /**
+     * Lowering of Stan statements and expressions to the IR of
+     * gen_pyro_ir.hpp.  One lowering runs over a whole program, keeping
+     * track of the local variables declared so far.
+     */
+    class pyro_ir_lowering {
+      const pyro_codegen_context& ctx_;
+
+      /**
+       * Local variables declared so far, by name.  Stan forbids
+       * shadowing, so a name maps to its latest declaration.
+       */
+      std::map<std::string, const var_decl*> locals_;
+
+      /**
+       * Lowered extents of the variables seen so far, by name.
+       */
+      std::map<std::string, std::vector<pyro_ir_expr_ptr> > extents_;
+
+    public:
+      /**
+       * Block of the statements being lowered.
+       */
+      pyro_block block_;
+
+      /**
+       * @param[in] ctx code generation state; must outlive the lowering
+       * @param[in] block block of the statements to lower
+       */
+      explicit pyro_ir_lowering(const pyro_codegen_context& ctx,
+                                pyro_block block = PYRO_MODEL_BLOCK)
+        : ctx_(ctx), block_(block) { }
+
+      const pyro_codegen_context& ctx() const {
+        return ctx_;
+      }
+
+      pyro_ir_expr_ptr expression(const stan::lang::expression& e);
+
+      /**
+       * @return lowered index of a multi-indexing expression or
+       * assignment
+       */
+      pyro_ir_expr_ptr index(const idx& i);
+
+      /**
+       * @param[in] name Stan identifier
+       * @param[in] type its Stan type
+       * @return the variable, with its block and extents
+       */
+      pyro_ir_expr_ptr variable(const std::string& name, const expr_type& type) {
+        std::shared_ptr<pyro_ir_expr> v(new pyro_ir_expr(PYRO_IR_VAR));
+        v->name_ = name;
+        v->text_ = ctx_.symbols_.py_name(name);
+        v->type_ = pyro_ir_type(type);
+        const var_decl* decl = 0;
+        std::map<std::string, const var_decl*>::const_iterator local = locals_.find(name);
+        if (local != locals_.end()) {
+          decl = local->second;
+        } else if (const pyro_symbol* sym = ctx_.symbols_.find(name)) {
+          v->block_ = sym->block_;
+          decl = sym->decl_;
+        }
+        if (decl) {
+          std::map<std::string, std::vector<pyro_ir_expr_ptr> >::iterator it
+            = extents_.find(name);
+          if (it == extents_.end()) {
+            pyro_decl_extents_vis vis;
+            std::vector<stan::lang::expression> es = boost::apply_visitor(vis, decl->decl_);
+            std::vector<pyro_ir_expr_ptr> extents;
+            for (size_t i = 0; i < es.size(); ++i)
+              extents.push_back(expression(es[i]));
+            it = extents_.insert(std::make_pair(name, extents)).first;
+          }
+          v->type_.extents_ = it->second;
+        }
+        return v;
+      }
+
+      /**
+       * @param[in] name Stan identifier of an assigned variable
+       * @param[in] decl its declared type
+       * @param[in] dims single indexes of the assigned element
+       * @return the variable or element
+       */
+      pyro_ir_expr_ptr lvalue(const std::string& name, const base_var_decl& decl,
+                              const std::vector<stan::lang::expression>& dims) {
+        expr_type type(decl.base_type_, decl.dims_.size());
+        pyro_ir_expr_ptr v = variable(name, type);
+        if (dims.empty()) return v;
+        std::vector<pyro_ir_expr_ptr> args(1, v);
+        for (size_t i = 0; i < dims.size(); ++i)
+          args.push_back(expression(dims[i]));
+        return pyro_ir_node(PYRO_IR_INDEX, "", args,
+                            pyro_ir_type(pyro_ir_index_type(type, dims.size())));
+      }
+
+      /**
+       * Lower a declaration to its initialization and enter it as a
+       * local variable if it is not a top-level one.
+       *
+       * @param[in] d declaration; must outlive the lowering
+       * @return declaration statement
+       */
+      pyro_ir_stmt_ptr declaration(const var_decl& d) {
+        base_var_decl_vis vis;
+        const base_var_decl* base = boost::apply_visitor(vis, d.decl_);
+        std::string name = d.name();
+        if (!ctx_.symbols_.find(name)) {
+          locals_[name] = &d;
+          extents_.erase(name);
+        }
+        std::stringstream ss;
+        generate_var_init_python(d, 0, ctx_, ss);
+        pyro_ir_stmt_ptr s(new pyro_ir_stmt(PYRO_IR_DECL, block_, 0));
+        s->lhs_ = variable(name, expr_type(base->base_type_, base->dims_.size()));
+        s->text_ = boost::algorithm::trim_right_copy(ss.str());
+        s->args_ = s->lhs_->type_.extents_;
+        pyro_decl_bounds_vis bounds;
+        std::vector<stan::lang::expression> es = boost::apply_visitor(bounds, d.decl_);
+        for (size_t i = 0; i < es.size(); ++i)
+          s->args_.push_back(expression(es[i]));
+        return s;
+      }
+
+      void statement(const stan::lang::statement& s, std::vector<pyro_ir_stmt_ptr>& out);
+
+      /**
+       * @return lowered statement s; empty for a no-op
+       */
+      std::vector<pyro_ir_stmt_ptr> statement(const stan::lang::statement& s) {
+        std::vector<pyro_ir_stmt_ptr> out;
+        statement(s, out);
+        return out;
+      }
+    };
+
+    /**
+     * Visitor lowering a Stan expression.  Every node gets the Stan type
+     * of its expression from pyro_ir_lowering::expression.
+     */
+    struct pyro_ir_expr_lowering_vis
+      : public boost::static_visitor<std::shared_ptr<pyro_ir_expr> > {
+      typedef std::shared_ptr<pyro_ir_expr> result;
+
+      pyro_ir_lowering& lw_;
+
+      explicit pyro_ir_expr_lowering_vis(pyro_ir_lowering& lw) : lw_(lw) { }
+
+      static result copy(const pyro_ir_expr_ptr& e) {
+        return result(new pyro_ir_expr(*e));
+      }
+
+      result node(pyro_ir_expr_kind kind, const std::string& name,
+                  const std::vector<expression>& args) const {
+        result e(new pyro_ir_expr(kind));
+        e->name_ = name;
+        for (size_t i = 0; i < args.size(); ++i)
+          e->args_.push_back(lw_.expression(args[i]));
+        return e;
+      }
+
+      result operator()(const nil& /*x*/) const {
+        return result();
+      }
+
+      result operator()(const int_literal& x) const {
+        return copy(pyro_ir_int(x.val_));
+      }
+
+      result operator()(const double_literal& x) const {
+        return copy(pyro_ir_real(x.val_));
+      }
+
+      result operator()(const array_expr& /*x*/) const {
+        throw pyro_unsupported_error("array_expr");
+      }
+
+      result operator()(const matrix_expr& /*x*/) const {
+        throw pyro_unsupported_error("matrix_expr");
+      }
+
+      result operator()(const row_vector_expr& /*x*/) const {
+        throw pyro_unsupported_error("row_vector_expr");
+      }
+
+      result operator()(const variable& x) const {
+        return copy(lw_.variable(x.name_, x.type_));
+      }
+
+      result operator()(const index_op& x) const {
+        std::vector<expression> args(1, x.expr_);
+        for (size_t i = 0; i < x.dimss_.size(); ++i)
+          args.insert(args.end(), x.dimss_[i].begin(), x.dimss_[i].end());
+        return node(PYRO_IR_INDEX, "", args);
+      }
+
+      result operator()(const index_op_sliced& x) const {
+        result e(new pyro_ir_expr(PYRO_IR_INDEX));
+        e->args_.push_back(lw_.expression(x.expr_));
+        for (size_t i = 0; i < x.idxs_.size(); ++i)
+          e->args_.push_back(lw_.index(x.idxs_[i]));
+        return e;
+      }
+
+      result operator()(const integrate_ode& x) const {
+        throw pyro_unsupported_error(x.integration_function_name_);
+      }
+
+      result operator()(const integrate_ode_control& x) const {
+        throw pyro_unsupported_error(x.integration_function_name_);
+      }
+
+      result operator()(const algebra_solver& /*x*/) const {
+        throw pyro_unsupported_error("algebra_solver");
+      }
+
+      result operator()(const algebra_solver_control& /*x*/) const {
+        throw pyro_unsupported_error("algebra_solver");
+      }
+
+      result operator()(const fun& x) const {
+        // Stan math functions may come qualified, stan::math::name
+        std::string name = x.name_;
+        size_t colon = name.rfind(':');
+        if (name.find("stan::") == 0 && colon != std::string::npos)
+          name = name.substr(colon + 1);
+        result e = node(PYRO_IR_CALL, name, x.args_);
+        e->user_defined_ = is_user_defined(x);
+        return e;
+      }
+
+      result operator()(const conditional_op& x) const {
+        std::vector<expression> args;
+        args.push_back(x.cond_);
+        args.push_back(x.true_val_);
+        args.push_back(x.false_val_);
+        return node(PYRO_IR_CONDITIONAL, "", args);
+      }
+
+      result operator()(const binary_op& x) const {
+        std::vector<expression> args;
+        args.push_back(x.left);
+        args.push_back(x.right);
+        return node(PYRO_IR_BINARY, x.op, args);
+      }
+
+      result operator()(const unary_op& x) const {
+        return node(PYRO_IR_UNARY, std::string(1, x.op),
+                    std::vector<expression>(1, x.subject));
+      }
+    };
+
+    pyro_ir_expr_ptr pyro_ir_lowering::expression(const stan::lang::expression& e) {
+      pyro_ir_expr_lowering_vis vis(*this);
+      std::shared_ptr<pyro_ir_expr> r = boost::apply_visitor(vis, e.expr_);
+      if (r && r->kind_ != PYRO_IR_VAR && r->kind_ != PYRO_IR_LITERAL)
+        r->type_ = pyro_ir_type(e.expression_type());
+      return r;
+    }
+
+    /**
+     * Visitor lowering an index: a single index or an array of them to
+     * its expression, and the others to a range.
+     */
+    struct pyro_ir_idx_lowering_vis
+      : public boost::static_visitor<pyro_ir_expr_ptr> {
+      pyro_ir_lowering& lw_;
+
+      explicit pyro_ir_idx_lowering_vis(pyro_ir_lowering& lw) : lw_(lw) { }
+
+      static pyro_ir_expr_ptr range(const pyro_ir_expr_ptr& lb, const pyro_ir_expr_ptr& ub) {
+        std::vector<pyro_ir_expr_ptr> args;
+        args.push_back(lb);
+        args.push_back(ub);
+        return pyro_ir_node(PYRO_IR_RANGE, "", args,
+                            pyro_ir_type(expr_type(base_expr_type(int_type()), 1)));
+      }
+
+      pyro_ir_expr_ptr operator()(const uni_idx& i) const {
+        return lw_.expression(i.idx_);
+      }
+
+      pyro_ir_expr_ptr operator()(const multi_idx& i) const {
+        return lw_.expression(i.idxs_);
+      }
+
+      pyro_ir_expr_ptr operator()(const omni_idx& /*i*/) const {
+        return range(pyro_ir_expr_ptr(), pyro_ir_expr_ptr());
+      }
+
+      pyro_ir_expr_ptr operator()(const lb_idx& i) const {
+        return range(lw_.expression(i.lb_), pyro_ir_expr_ptr());
+      }
+
+      pyro_ir_expr_ptr operator()(const ub_idx& i) const {
+        return range(pyro_ir_expr_ptr(), lw_.expression(i.ub_));
+      }
+
+      pyro_ir_expr_ptr operator()(const lub_idx& i) const {
+        return range(lw_.expression(i.lb_), lw_.expression(i.ub_));
+      }
+    };
+
+    pyro_ir_expr_ptr pyro_ir_lowering::index(const idx& i) {
+      pyro_ir_idx_lowering_vis vis(*this);
+      return boost::apply_visitor(vis, i.idx_);
+    }
+
+    /**
+     * Visitor lowering a Stan statement, appending the result to a
+     * sequence of statements.
+     */
+    struct pyro_ir_stmt_lowering_vis : public boost::static_visitor<void> {
+      pyro_ir_lowering& lw_;
+
+      /**
+       * First line of the statement.
+       */
+      size_t line_;
+
+      std::vector<pyro_ir_stmt_ptr>& out_;
+
+      pyro_ir_stmt_lowering_vis(pyro_ir_lowering& lw, size_t line,
+                                std::vector<pyro_ir_stmt_ptr>& out)
+        : lw_(lw), line_(line), out_(out) { }
+
+      pyro_ir_stmt_ptr add(pyro_ir_stmt_kind kind) const {
+        pyro_ir_stmt_ptr s(new pyro_ir_stmt(kind, lw_.block_, line_));
+        out_.push_back(s);
+        return s;
+      }
+
+      /**
+       * Assignment of lhs, or compound assignment with op, which is
+       * either an operator followed by = or the name of the function
+       * applying it.
+       */
+      void assign(const pyro_ir_expr_ptr& lhs, const std::string& op,
+                  const std::string& op_name, const expression& rhs) const {
+        pyro_ir_stmt_ptr s = add(PYRO_IR_ASSIGN);
+        s->lhs_ = lhs;
+        s->rhs_ = lw_.expression(rhs);
+        if (!op_name.empty()) {
+          std::vector<pyro_ir_expr_ptr> args;
+          args.push_back(lhs);
+          args.push_back(s->rhs_);
+          s->rhs_ = pyro_ir_node(PYRO_IR_CALL, op_name, args, lhs->type_);
+        } else if (!op.empty() && op != "=") {
+          s->rhs_ = pyro_ir_binary(boost::algorithm::erase_last_copy(op, "="),
+                                   lhs, s->rhs_, lhs->type_);
+        }
+      }
+
+      void operator()(const nil& /*x*/) const { }
+
+      void operator()(const no_op_statement& /*x*/) const { }
+
+      void operator()(const assignment& x) const {
+        assign(lw_.lvalue(x.var_dims_.name_, x.var_type_, x.var_dims_.dims_),
+               "=", "", x.expr_);
+      }
+
+      void operator()(const compound_assignment& x) const {
+        assign(lw_.lvalue(x.var_dims_.name_, x.var_type_, x.var_dims_.dims_),
+               x.op_, x.op_name_, x.expr_);
+      }
+
+      void operator()(const assgn& x) const {
+        std::vector<pyro_ir_expr_ptr> args(1, lw_.expression(x.lhs_var_));
+        bool gathered = false;
+        for (size_t i = 0; i < x.idxs_.size(); ++i) {
+          // elements picked by an array of indexes are a copy, so only
+          // omitted indexes may follow one
+          if (gathered && !boost::get<omni_idx>(&x.idxs_[i].idx_))
+            throw pyro_unsupported_error("assignment to a multi-index followed by other indexes");
+          gathered = gathered || boost::get<multi_idx>(&x.idxs_[i].idx_);
+          args.push_back(lw_.index(x.idxs_[i]));
+        }
+        pyro_ir_expr_ptr lhs = args[0];
+        if (args.size() > 1)
+          lhs = pyro_ir_node(PYRO_IR_INDEX, "", args,
+                             pyro_ir_type(indexed_type(x.lhs_var_, x.idxs_)));
+        assign(lhs, x.op_, x.op_name_, x.rhs_);
+      }
+
+      void operator()(const sample& x) const {
+        pyro_ir_expr_ptr lhs = lw_.expression(x.expr_);
+        if (lhs && lhs->is_literal())
+          throw pyro_unsupported_error("SAMPLING CONSTANTS NOT SUPPORTED");
+        pyro_ir_stmt_ptr s = add(PYRO_IR_SAMPLE);
+        s->lhs_ = lhs;
+        s->name_ = x.dist_.family_;
+        for (size_t i = 0; i < x.dist_.args_.size(); ++i)
+          s->args_.push_back(lw_.expression(x.dist_.args_[i]));
+        s->truncated_ = x.truncation_.has_low() || x.truncation_.has_high();
+      }
+
+      void operator()(const increment_log_prob_statement& x) const {
+        add(PYRO_IR_FACTOR)->rhs_ = lw_.expression(x.log_prob_);
+      }
+
+      void operator()(const expression& x) const {
+        add(PYRO_IR_EXPR)->rhs_ = lw_.expression(x);
+      }
+
+      void operator()(const statements& x) const {
+        pyro_ir_stmt_ptr s = add(PYRO_IR_BLOCK);
+        for (size_t i = 0; i < x.local_decl_.size(); ++i)
+          s->decls_.push_back(lw_.declaration(x.local_decl_[i]));
+        for (size_t i = 0; i < x.statements_.size(); ++i)
+          lw_.statement(x.statements_[i], s->body_);
+      }
+
+      void operator()(const for_statement& x) const {
+        pyro_ir_stmt_ptr s = add(PYRO_IR_FOR);
+        s->name_ = x.variable_;
+        s->args_.push_back(lw_.expression(x.range_.low_));
+        s->args_.push_back(lw_.expression(x.range_.high_));
+        lw_.statement(x.statement_, s->body_);
+      }
+
+      void operator()(const for_array_statement& /*x*/) const {
+        throw pyro_unsupported_error("for_array_statement");
+      }
+
+      void operator()(const for_matrix_statement& /*x*/) const {
+        throw pyro_unsupported_error("for_matrix_statement");
+      }
+
+      void operator()(const while_statement& x) const {
+        pyro_ir_stmt_ptr s = add(PYRO_IR_WHILE);
+        s->rhs_ = lw_.expression(x.condition_);
+        lw_.statement(x.body_, s->body_);
+      }
+
+      void operator()(const conditional_statement& x) const {
+        pyro_ir_stmt_ptr s = add(PYRO_IR_IF);
+        for (size_t i = 0; i < x.conditions_.size(); ++i)
+          s->args_.push_back(lw_.expression(x.conditions_[i]));
+        for (size_t i = 0; i < x.bodies_.size(); ++i)
+          s->bodies_.push_back(lw_.statement(x.bodies_[i]));
+      }
+
+      void operator()(const break_continue_statement& x) const {
+        add(PYRO_IR_VERBATIM)->text_ = x.generate_ + ";";
+      }
+
+      void operator()(const print_statement& /*x*/) const {
+        throw pyro_unsupported_error("print_statement");
+      }
+
+      void operator()(const reject_statement& /*x*/) const {
+        throw pyro_unsupported_error("reject_statement");
+      }
+
+      void operator()(const return_statement& /*x*/) const {
+        throw pyro_unsupported_error("return_statement");
+      }
+    };
+
+    void pyro_ir_lowering::statement(const stan::lang::statement& s,
+                                     std::vector<pyro_ir_stmt_ptr>& out) {
+      pyro_ir_stmt_lowering_vis vis(*this, s.begin_line_, out);
+      boost::apply_visitor(vis, s.statement_);
+    }
+
+    /**
+     * Lower the declarations and statements of a block.
+     */
+    void pyro_lower_block(pyro_ir_lowering& lw, pyro_block block,
+                          const std::vector<var_decl>& decls,
+                          const std::vector<statement>& ss,
+                          std::vector<pyro_ir_stmt_ptr>& out) {
+      lw.block_ = block;
+      for (size_t i = 0; i < decls.size(); ++i)
+        out.push_back(lw.declaration(decls[i]));
+      for (size_t i = 0; i < ss.size(); ++i)
+        lw.statement(ss[i], out);
+    }
+
+    /**
+     * @param[in] ctx code generation state
+     * @return the statements of the program, lowered
+     */
+    pyro_ir_program pyro_lower_program(const pyro_codegen_context& ctx) {
+      const program& p = ctx.p_;
+      pyro_ir_program ir;
+      pyro_ir_lowering lw(ctx);
+      pyro_lower_block(lw, PYRO_PARAMETER_BLOCK, p.parameter_decl_, std::vector<statement>(),
+                       ir.parameters_);
+      pyro_lower_block(lw, PYRO_TRANSFORMED_DATA_BLOCK, p.derived_data_decl_.first,
+                       p.derived_data_decl_.second, ir.transformed_data_);
+      pyro_lower_block(lw, PYRO_TRANSFORMED_PARAMETER_BLOCK, p.derived_decl_.first,
+                       p.derived_decl_.second, ir.transformed_parameters_);
+      pyro_lower_block(lw, PYRO_MODEL_BLOCK, std::vector<var_decl>(),
+                       std::vector<statement>(1, p.statement_), ir.model_);
+      return ir;
+    }
+
+  }
+}
+#endif
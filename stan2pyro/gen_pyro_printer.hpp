@@ -0,0 +1,573 @@
+#ifndef STAN2PYRO_GEN_PYRO_PRINTER_HPP
+#define STAN2PYRO_GEN_PYRO_PRINTER_HPP
+
+#include <stan/lang/ast.hpp>
+#include <stan/lang/generator/constants.hpp>
+#include <stan/lang/generator/generate_indent.hpp>
+#include <gen_pyro_context.hpp>
+#include <gen_pyro_ir.hpp>
+#include <gen_pyro_lower.hpp>
+#include <gen_pyro_functions.hpp>
+#include <gen_pyro_distributions.hpp>
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#define NOT_USER_FACING false
+
+namespace stan {
+  namespace lang {
+
+    std::string escape_chars(std::string s){
+        std::replace( s.begin(), s.end(), '"', ' ');
+        return s;
+    }
+
+    /**
+     * Printer of the IR as Python, the last step of code generation.
+     *
+     * Elements of variables, which are tensors at run time, print as a
+     * single subscript, v[i - 1, j - 1], when proven in bounds; an int
+     * index that may not be a Python int, such as an element of an int
+     * array, goes through int, and other indexes through _checked_index.
+     * One tensor of indexes gathers along its dimension.
+     * Elements of other values print as _index_select(e, i - 1) calls,
+     * which accept Python numbers and lists as well as tensors, except
+     * in index mode, used for assignment targets and indexes themselves.
+     */
+    class pyro_ir_printer {
+      /**
+       * Indices of the for loops enclosing the statement being printed.
+       */
+      std::set<std::string> for_indices_;
+
+    public:
+      std::string expr(const pyro_ir_expr_ptr& e, bool is_index) const {
+        if (!e) return "nil";
+        switch (e->kind_) {
+          case PYRO_IR_LITERAL:
+          case PYRO_IR_VAR:
+            return e->text_;
+          case PYRO_IR_INDEX:
+            return index(*e, is_index);
+          case PYRO_IR_SLICE:
+            return expr(e->args_[0], false) + "[" + bare(e->args_[1], true) + ":"
+              + bare(e->args_[2], true) + "]";
+          case PYRO_IR_RANGE:
+            // only an index, printed by index()
+            return position(e->args_[0], 1) + ":" + position(e->args_[1], 0);
+          case PYRO_IR_CALL:
+            return call(*e, is_index);
+          case PYRO_IR_BINARY:
+            // Python's % and / floor, Stan's truncate
+            if (e->name_ == "%")
+              return "_modulus(" + bare(e->args_[0], is_index) + ", "
+                + bare(e->args_[1], is_index) + ")";
+            if (is_int_division(*e))
+              return "_int_divide(" + bare(e->args_[0], is_index) + ", "
+                + bare(e->args_[1], is_index) + ")";
+            return "(" + bare(e, is_index) + ")";
+          case PYRO_IR_UNARY:
+            return e->name_ + "(" + expr(e->args_[0], is_index) + ")";
+          case PYRO_IR_CONDITIONAL:
+            return "(" + expr(e->args_[1], is_index) + " if as_bool("
+              + expr(e->args_[0], is_index) + ") else "
+              + expr(e->args_[2], is_index) + ")";
+          case PYRO_IR_PYTHON: {
+            std::string s = e->name_ + "(";
+            for (size_t i = 0; i < e->args_.size(); ++i)
+              s += (i > 0 ? ", " : "") + bare(e->args_[i], is_index);
+            return s + ")";
+          }
+        }
+        return "";
+      }
+
+      /**
+       * @return true if e is a / of two ints, which truncates in Stan
+       */
+      static bool is_int_division(const pyro_ir_expr& e) {
+        return e.name_ == "/" && e.args_.size() == 2
+          && e.args_[0]->type_.dtype() == PYRO_IR_INT && e.args_[0]->type_.is_scalar()
+          && e.args_[1]->type_.dtype() == PYRO_IR_INT && e.args_[1]->type_.is_scalar();
+      }
+
+      /**
+       * @param[in] e int expression
+       * @return true if e is a Python int at run time: an int literal,
+       * the index of an enclosing for loop, a conversion by the run time,
+       * or a sum, difference or product of those
+       */
+      bool is_python_int(const pyro_ir_expr_ptr& e) const {
+        if (!e || e->type_.dtype() != PYRO_IR_INT || !e->type_.is_scalar()) return false;
+        switch (e->kind_) {
+          case PYRO_IR_LITERAL:
+          case PYRO_IR_PYTHON:
+            return true;
+          case PYRO_IR_VAR:
+            return for_indices_.count(e->name_) > 0;
+          case PYRO_IR_BINARY:
+            return e->name_ != "/" && e->name_ != "%"
+              && is_python_int(e->args_[0]) && is_python_int(e->args_[1]);
+          case PYRO_IR_UNARY:
+            return is_python_int(e->args_[0]);
+          default:
+            return false;
+        }
+      }
+
+      /**
+       * @param[in] ix int index or bound; may be null
+       * @param[in] offset amount to subtract
+       * @param[in] convert function turning ix into a Python int when it
+       * may not be one; none if empty
+       * @return ix - offset as a Python int, with the constant of ix
+       * of the form i + c or i - c folded in; empty if ix is null
+       */
+      std::string position(pyro_ir_expr_ptr ix, long offset,
+                           const std::string& convert = "to_int") const {
+        if (!ix) return "";
+        while (ix->kind_ == PYRO_IR_BINARY && (ix->name_ == "+" || ix->name_ == "-")
+               && ix->type_.dtype() == PYRO_IR_INT && ix->args_[1]->is_int_literal()) {
+          long c = static_cast<long>(ix->args_[1]->value_);
+          offset += ix->name_ == "+" ? -c : c;
+          ix = ix->args_[0];
+        }
+        if (ix->is_int_literal())
+          return boost::lexical_cast<std::string>(long(ix->value_) - offset);
+        std::string s = is_python_int(ix) || convert.empty() ? bare(ix, true)
+          : convert + "(" + bare(ix, true) + ")";
+        if (offset > 0) return s + " - " + boost::lexical_cast<std::string>(offset);
+        if (offset < 0) return s + " + " + boost::lexical_cast<std::string>(-offset);
+        return s;
+      }
+
+      /**
+       * @param[in] ix single index of a variable
+       * @param[in] in_bounds true if the access is proven within the
+       * extents of the variable (see pyro_bounds_analysis)
+       * @return its 0-based position, through _checked_index unless it
+       * is proven in bounds or a positive literal: torch rejects
+       * positions past the end, but not negative ones, which count from
+       * the end
+       */
+      std::string element(const pyro_ir_expr_ptr& ix, bool in_bounds) const {
+        if (ix->is_int_literal() && ix->value_ >= 1) return position(ix, 1);
+        if (in_bounds) return position(ix, 1, "int");
+        return "_checked_index(" + position(ix, 1, "") + ")";
+      }
+
+      /**
+       * @return s subscripted by subs, or s if they all keep the whole
+       * dimension
+       */
+      static std::string subscript(const std::string& s,
+                                   const std::vector<std::string>& subs) {
+        if (std::count(subs.begin(), subs.end(), ":") == long(subs.size())) return s;
+        std::string r = s + "[";
+        for (size_t i = 0; i < subs.size(); ++i)
+          r += (i > 0 ? ", " : "") + subs[i];
+        return r + "]";
+      }
+
+      /**
+       * @return element or slice of an indexed value.  Ranges print as
+       * Python slices and arrays of indexes as gathers, both in
+       * subscripts of tensors.  Single indexes of a variable, which is
+       * a tensor unless it is a scalar, print in one subscript, those of
+       * another value as nested _index_select calls.
+       */
+      std::string index(const pyro_ir_expr& e, bool is_index) const {
+        const pyro_ir_expr_ptr& base = e.args_[0];
+        bool sliced = false;
+        for (size_t i = 1; i < e.args_.size(); ++i)
+          sliced = sliced || !e.args_[i]->type_.is_scalar();
+        if (!sliced && !(base->kind_ == PYRO_IR_VAR && base->type_.rank() >= e.args_.size() - 1
+                         && base->type_.dtype() != PYRO_IR_NO_DTYPE)) {
+          std::string s = expr(base, false);
+          for (size_t i = 1; i < e.args_.size(); ++i) {
+            std::string ix = position(e.args_[i], 1);
+            if (is_index) s += "[" + ix + "]";
+            else s = "_index_select(" + s + ", " + ix + ") ";
+          }
+          return s;
+        }
+        // Python pairs up the arrays in a subscript, and the single
+        // indexes not next to them, instead of crossing them; so each
+        // array gets a subscript of its own, past the dimensions kept
+        // before it
+        std::string s = expr(base, false);
+        std::vector<std::string> subs;
+        size_t kept = 0;
+        for (size_t i = 1; i < e.args_.size(); ++i) {
+          const pyro_ir_expr_ptr& ix = e.args_[i];
+          if (ix->kind_ == PYRO_IR_RANGE) {
+            subs.push_back(position(ix->args_[0], 1) + ":" + position(ix->args_[1], 0));
+            ++kept;
+          } else if (!ix->type_.is_scalar()) {
+            s = subscript(s, subs);
+            subs.assign(kept, ":");
+            std::string p = position(ix, 1, "");
+            subs.push_back((p.find(' ') == std::string::npos ? p : "(" + p + ")") + ".long()");
+            s = subscript(s, subs);
+            subs.assign(++kept, ":");
+          } else {
+            subs.push_back(element(ix, e.in_bounds_));
+          }
+        }
+        return subscript(s, subs);
+      }
+
+      /**
+       * @return e without the parentheses around a binary operator,
+       * for positions that need none, such as function arguments
+       */
+      std::string bare(const pyro_ir_expr_ptr& e, bool is_index) const {
+        if (!e || e->kind_ != PYRO_IR_BINARY || e->name_ == "%" || is_int_division(*e))
+          return expr(e, is_index);
+        return expr(e->args_[0], is_index) + " " + e->name_ + " "
+          + expr(e->args_[1], is_index);
+      }
+
+      /**
+       * @return log density of the call e, summed over the elements of
+       * its variate as in Stan, which is shifted to Pyro's values (see
+       * pyro_distribution_def)
+       */
+      std::string density(const pyro_ir_expr& e, const pyro_distribution_def& def,
+                          const std::vector<std::string>& args) const {
+        std::vector<pyro_ir_expr_ptr> params(e.args_.begin() + 1, e.args_.end());
+        std::vector<std::string> py_params(args.begin() + 1, args.end());
+        // int and real data are Python numbers
+        std::string y = e.args_[0]->type_.is_scalar() ? "_as_tensor(" + args[0] + ")" : args[0];
+        if (def.offset_ != 0) y += " - " + boost::lexical_cast<std::string>(def.offset_);
+        return pyro_expand_function(def.python_, pyro_ir_types(params), py_params)
+          + ".log_prob(" + y + ").sum()";
+      }
+
+      std::string call(const pyro_ir_expr& e, bool is_index) const {
+        std::vector<std::string> args;
+        for (size_t i = 0; i < e.args_.size(); ++i)
+          args.push_back(expr(e.args_[i], is_index));
+        if (e.name_ == "logical_or" || e.name_ == "logical_and")
+          return "(as_bool(" + args[0] + ") "
+            + (e.name_ == "logical_or" ? "or" : "and")
+            + " as_bool(" + args[1] + "))";
+        if (!e.user_defined_)
+          if (const pyro_distribution_def* def
+              = pyro_density_distribution(e.name_, pyro_ir_types(e.args_)))
+            return density(e, *def, args);
+        bool rng = has_rng_suffix(e.name_), lp = has_lp_suffix(e.name_);
+        if (!rng && !lp && !e.user_defined_) {
+          const pyro_function_def* def
+            = pyro_function_registry::instance().find(e.name_, pyro_ir_types(e.args_));
+          if (def)
+            return pyro_expand_function(def->python_, pyro_ir_types(e.args_), args);
+        }
+        std::string s = "_call_func(\"" + e.name_ + "\", [";
+        for (size_t i = 0; i < args.size(); ++i)
+          s += (i > 0 ? "," : "") + args[i];
+        if (args.size() > 0 && (rng || lp))
+          s += ", ";
+        if (rng)
+          s += "base_rng__";
+        if (lp)
+          s += "lp__, lp_accum__";
+        if (e.user_defined_) {
+          if (args.size() > 0 || rng || lp)
+            s += ", ";
+          s += "pstream__";
+        }
+        return s + "])";
+      }
+
+      /**
+       * @param[in] lhs sampled expression
+       * @param[in] as_tensor true to convert the observation to a tensor
+       * @param[in] offset Stan value of Pyro's 0 (see
+       * pyro_distribution_def)
+       * @return ", obs=..." if the sampled expression is data, or an
+       * element or slice of data, otherwise nothing
+       */
+      std::string observe(const pyro_ir_expr_ptr& lhs, bool as_tensor, int offset) const {
+        const pyro_ir_expr* var = pyro_ir_base_var(lhs);
+        if (var == 0 || (var->block_ != PYRO_DATA_BLOCK
+                         && var->block_ != PYRO_TRANSFORMED_DATA_BLOCK))
+          return "";
+        std::string obs = as_tensor ? "_as_tensor(" + expr(lhs, false) + ")" : expr(lhs, false);
+        if (offset != 0) obs += " - " + boost::lexical_cast<std::string>(offset);
+        return ", obs=" + obs;
+      }
+
+      /**
+       * Print the sample of an enumerated latent variable, one site per
+       * iteration of the enclosing for loops, shifted to the 1-based
+       * category that Stan code reads.
+       */
+      void enumerated(const pyro_ir_stmt& x, int indent, std::ostream& o) const {
+        generate_indent(indent, o);
+        std::string name = x.lhs_->text_, indexes;
+        for (std::set<std::string>::const_iterator it = for_indices_.begin();
+             it != for_indices_.end(); ++it) {
+          name += "[%d]";
+          indexes += *it + ",";
+        }
+        std::string site = "\"" + name + "\"";
+        if (!indexes.empty()) site += " % (" + indexes + ")";
+        std::vector<std::string> args;
+        for (size_t i = 0; i < x.args_.size(); ++i)
+          args.push_back(expr(x.args_[i], false));
+        const pyro_distribution_def* def
+          = pyro_distribution_registry::instance().find(x.name_, pyro_ir_types(x.args_));
+        o << x.lhs_->text_ << " = pyro.sample(" << site << ", "
+          << pyro_expand_function(def->python_, pyro_ir_types(x.args_), args)
+          << ", infer={\"enumerate\": \"parallel\"}) + 1" << EOL;
+      }
+
+      void sample(const pyro_ir_stmt& x, int indent, std::ostream& o) const {
+        if (x.enumerated_) {
+          enumerated(x, indent, o);
+          return;
+        }
+        generate_indent(indent, o);
+        std::string lhs_expr = expr(x.lhs_, true);
+        o << lhs_expr << " = ";
+
+        // site name
+        std::string site;
+        bool sliced = false, gathered = false;
+        if (x.lhs_->kind_ == PYRO_IR_INDEX || x.lhs_->kind_ == PYRO_IR_SLICE) {
+          std::string name = expr(x.lhs_->args_[0], false);
+          std::vector<std::string> indexes;
+          if (x.lhs_->kind_ == PYRO_IR_SLICE) {
+            // one site for the whole plate
+            sliced = true;
+            indexes.push_back(bare(x.lhs_->args_[1], true));
+            indexes.push_back(bare(x.lhs_->args_[2], true));
+            name += "[%d:%d]";
+          } else {
+            for (size_t i = 1; i < x.lhs_->args_.size(); ++i) {
+              const pyro_ir_expr_ptr& ix = x.lhs_->args_[i];
+              if (ix->kind_ == PYRO_IR_RANGE) {
+                // bounds of the Python slice, as for sliced loops
+                name += "[";
+                for (size_t j = 0; j < 2; ++j) {
+                  if (j > 0) name += ":";
+                  if (!ix->args_[j]) continue;
+                  indexes.push_back(position(ix->args_[j], j == 0 ? 1 : 0));
+                  name += "%d";
+                }
+                name += "]";
+              } else if (!ix->type_.is_scalar()) {
+                name += "[" + boost::replace_all_copy(bare(ix, true), "%", "%%") + "]";
+                gathered = true;
+              } else {
+                indexes.push_back(position(ix, 1));
+                name += "[%d]";
+              }
+            }
+          }
+          // a plate inside for loops samples once per iteration of them
+          if (sliced || gathered)
+            for (std::set<std::string>::const_iterator it = for_indices_.begin();
+                 it != for_indices_.end(); ++it) {
+              name += "[%d]";
+              indexes.push_back(*it);
+            }
+          site = "\"" + escape_chars(name) + "\"";
+          if (!indexes.empty()) {
+            site += " % (";
+            for (size_t i = 0; i < indexes.size(); ++i)
+              site += indexes[i] + (i < indexes.size() - 1 ? "," : ")");
+          }
+        } else {
+          site = "\"" + escape_chars(lhs_expr) + "\"";
+        }
+
+        std::vector<std::string> args;
+        bool expand = false, batched = false;
+        for (size_t i = 0; i < x.args_.size(); ++i) {
+          args.push_back(expr(x.args_[i], false));
+          expand = expand || x.args_[i]->type_.is_scalar();
+          batched = batched || pyro_ir_same_shape(x.args_[i]->type_, x.lhs_->type_);
+        }
+        const pyro_distribution_def* def
+          = pyro_distribution_registry::instance().find(x.name_, pyro_ir_types(x.args_));
+        if (def) {
+          o << " pyro.sample(" << site << ", "
+            << pyro_expand_function(def->python_, pyro_ir_types(x.args_), args);
+          // scalar arguments only broadcast to the shape of the sampled
+          // tensor, unless another argument has that shape; in a plate,
+          // pyro.plate broadcasts them
+          if (def->univariate_ && !x.lhs_->type_.is_scalar() && expand && !batched && !sliced)
+            o << ".expand(" << lhs_expr << ".shape)";
+          // int and real data are Python numbers
+          o << observe(x.lhs_, x.lhs_->kind_ == PYRO_IR_VAR && x.lhs_->type_.is_scalar(),
+                       def->offset_)
+            << ")";
+          // back to the Stan values the lhs holds
+          if (def->offset_ != 0) o << " + " << def->offset_;
+          o << EOL;
+          return;
+        }
+
+        o << " _pyro_sample(" << expr(x.lhs_, false) << ", " << site
+          << ", \"" << x.name_ << "\", [";
+        for (size_t i = 0; i < args.size(); ++i)
+          o << (i != 0 ? ", " : "") << args[i];
+        o << "]" << observe(x.lhs_, false, 0) << ")" << EOL;
+      }
+
+      /**
+       * Print target += rhs as an addition to the accumulator, of the
+       * sum of rhs unless it is known to be a scalar.
+       */
+      void factor(const pyro_ir_stmt& x, int indent, std::ostream& o) const {
+        generate_indent(indent, o);
+        const pyro_ir_type& t = x.rhs_->type_;
+        std::string s = t.shaped_ && t.extents_.empty() ? bare(x.rhs_, false)
+          : "torch.sum(_as_tensor(" + expr(x.rhs_, false) + "))";
+        o << x.text_ << " = " << x.text_ << " + " << s << EOL;
+      }
+
+      /**
+       * @return Python int of a loop bound
+       */
+      std::string loop_bound(const pyro_ir_expr_ptr& e) const {
+        std::string s = expr(e, true);
+        return e && e->is_int_literal() ? s : "to_int(" + s + ")";
+      }
+
+      void statements(const std::vector<pyro_ir_stmt_ptr>& ss, int indent,
+                      std::ostream& o) {
+        for (size_t i = 0; i < ss.size(); ++i)
+          statement(*ss[i], indent, o);
+      }
+
+      /**
+       * Print the body of a compound statement, which Python requires
+       * to be non-empty.
+       */
+      void body(const std::vector<pyro_ir_stmt_ptr>& ss, int indent,
+                std::ostream& o) {
+        if (ss.empty()) {
+          generate_indent(indent, o);
+          o << "pass" << EOL;
+        }
+        statements(ss, indent, o);
+      }
+
+      void statement(const pyro_ir_stmt& x, int indent, std::ostream& o) {
+        switch (x.kind_) {
+          case PYRO_IR_DECL:
+          case PYRO_IR_VERBATIM:
+            generate_indent(indent, o);
+            o << x.text_ << EOL;
+            return;
+          case PYRO_IR_ASSIGN: {
+            generate_indent(indent, o);
+            std::string lhs = expr(x.lhs_, true);
+            // a tensor of the same shape needs no broadcasting
+            if (!x.lhs_->type_.extents_.empty()
+                && pyro_ir_same_shape(x.lhs_->type_, x.rhs_->type_))
+              o << lhs << " = " << bare(x.rhs_, false) << EOL;
+            else
+              o << lhs << " = _pyro_assign(" << lhs << ", "
+                << expr(x.rhs_, false) << ")" << EOL;
+            return;
+          }
+          case PYRO_IR_LET:
+            generate_indent(indent, o);
+            o << expr(x.lhs_, true) << " = " << bare(x.rhs_, false) << EOL;
+            return;
+          case PYRO_IR_SAMPLE:
+            sample(x, indent, o);
+            return;
+          case PYRO_IR_FACTOR:
+            factor(x, indent, o);
+            return;
+          case PYRO_IR_EXPR:
+            generate_indent(indent, o);
+            o << expr(x.rhs_, false) << ";" << EOL;
+            return;
+          case PYRO_IR_FOR:
+            for_indices_.insert(x.name_);
+            generate_indent(indent, o);
+            if (x.zero_based_)
+              o << "for " << x.name_ << " in range(" << position(x.args_[0], 1)
+                << ", " << position(x.args_[1], 0) << "):" << EOL;
+            else
+              o << "for " << x.name_ << " in range(" << loop_bound(x.args_[0])
+                << ", " << loop_bound(x.args_[1]) << " + 1):" << EOL;
+            body(x.body_, indent + 1, o);
+            for_indices_.erase(x.name_);
+            return;
+          case PYRO_IR_WHILE:
+            generate_indent(indent, o);
+            o << "while as_bool(" << expr(x.rhs_, false) << "):" << EOL;
+            body(x.body_, indent + 1, o);
+            return;
+          case PYRO_IR_PLATE:
+            generate_indent(indent, o);
+            o << "with pyro.plate(\"" << x.name_ << "\", " << bare(x.args_[0], true);
+            if (x.args_.size() > 1)
+              o << ", subsample_size=" << bare(x.args_[1], true) << ") as " << x.lhs_->text_;
+            else
+              o << ")";
+            o << ":" << EOL;
+            body(x.body_, indent + 1, o);
+            return;
+          case PYRO_IR_IF:
+            for (size_t i = 0; i < x.args_.size(); ++i) {
+              if (i == 0)
+                generate_indent(indent, o);
+              else
+                o << " else: ";
+              o << "if (as_bool(" << expr(x.args_[i], false) << ")):" << EOL;
+              body(x.bodies_[i], indent + 1, o);
+              generate_indent(indent, o);
+            }
+            if (x.bodies_.size() > x.args_.size()) {
+              o << "else: " << EOL;
+              body(x.bodies_.back(), indent + 1, o);
+              generate_indent(indent, o);
+            }
+            o << EOL;
+            return;
+          case PYRO_IR_BLOCK:
+            if (!x.decls_.empty()) {
+              generate_indent(indent, o);
+              o << "# {" << EOL;
+              statements(x.decls_, indent, o);
+            }
+            o << EOL;
+            statements(x.body_, indent, o);
+            if (!x.decls_.empty()) {
+              generate_indent(indent, o);
+              o << "# }" << EOL;
+            }
+            return;
+        }
+      }
+    };
+
+    void pyro_generate_expression(const expression& e, bool user_facing,
+                                  const pyro_codegen_context& ctx, std::ostream& o) {
+      pyro_ir_lowering lw(ctx);
+      o << pyro_ir_printer().expr(lw.expression(e), false);
+    }
+
+    // generate expression when the variable is an index
+    void pyro_generate_expression_as_index(const expression& e, bool user_facing,
+                             const pyro_codegen_context& ctx, std::ostream& o) {
+      pyro_ir_lowering lw(ctx);
+      o << pyro_ir_printer().expr(lw.expression(e), true);
+    }
+
+  }
+}
+#endif
@@ -0,0 +1,197 @@
+#ifndef STAN2PYRO_GEN_PYRO_SHAPES_HPP
+#define STAN2PYRO_GEN_PYRO_SHAPES_HPP
+
+#include <stan/lang/ast.hpp>
+#include <gen_pyro_context.hpp>
+#include <gen_pyro_ir.hpp>
+#include <gen_pyro_vectorize.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace stan {
+  namespace lang {
+
+    /**
+     * Static shape inference.  Annotates every expression with the shape
+     * of its value at run time, as symbolic extents such as N or K taken
+     * from the declarations of the variables it reads (see
+     * pyro_ir_type::shaped_):
+     *
+     *   vector[N] mu;  ...  mu[2:N]      (N - 2 + 1)
+     *   sigma + 2.0 * mu[0:to_int(N)]    (to_int(N))
+     *
+     * Slices, ranges and gathers set the extent of their dimension,
+     * single indexes drop it, scalars broadcast against tensors, and
+     * elementwise operations and functions keep the shape of their
+     * operands when these agree.  Anything else is left without a
+     * shape.  Runs last, so that the printer can skip the run-time
+     * broadcasting of _pyro_assign and of sampled values where shapes
+     * are statically equal.
+     */
+    class pyro_shape_inference {
+      /**
+       * Types of the compiler temporaries bound so far.
+       */
+      std::map<std::string, pyro_ir_type> temps_;
+
+      static pyro_ir_expr_ptr int_binary(const std::string& op, const pyro_ir_expr_ptr& a,
+                                         const pyro_ir_expr_ptr& b) {
+        if (a->is_int_literal() && b->is_int_literal())
+          return pyro_ir_int(op == "+" ? long(a->value_) + long(b->value_)
+                             : long(a->value_) - long(b->value_));
+        return pyro_ir_binary(op, a, b, pyro_ir_type(expr_type(base_expr_type(int_type()), 0)));
+      }
+
+      /**
+       * @return extent of the 1-based inclusive range lb..ub of a
+       * dimension of extent n; lb and ub may be null
+       */
+      static pyro_ir_expr_ptr range_extent(const pyro_ir_expr_ptr& lb, const pyro_ir_expr_ptr& ub,
+                                           const pyro_ir_expr_ptr& n) {
+        const pyro_ir_expr_ptr& hi = ub ? ub : n;
+        if (!lb || (lb->is_int_literal() && lb->value_ == 1)) return hi;
+        return int_binary("+", int_binary("-", hi, lb), pyro_ir_int(1));
+      }
+
+      /**
+       * @return extent of the 0-based half-open slice lo:hi
+       */
+      static pyro_ir_expr_ptr slice_extent(const pyro_ir_expr_ptr& lo, const pyro_ir_expr_ptr& hi) {
+        if (lo->is_int_literal() && lo->value_ == 0) return hi;
+        return int_binary("-", hi, lo);
+      }
+
+      static void shape(pyro_ir_expr& e, const std::vector<pyro_ir_expr_ptr>& extents) {
+        e.type_.extents_ = extents;
+        e.type_.shaped_ = true;
+      }
+
+      /**
+       * Give e the shape of a and b broadcast together, if they have
+       * one.
+       */
+      static void broadcast(pyro_ir_expr& e, const pyro_ir_type& a, const pyro_ir_type& b) {
+        if (!a.shaped_ || !b.shaped_) return;
+        if (a.extents_.empty()) shape(e, b.extents_);
+        else if (b.extents_.empty() || pyro_ir_same_shape(a, b)) shape(e, a.extents_);
+      }
+
+      static bool is_elementwise_binary_function(const std::string& name) {
+        return name == "add" || name == "subtract" || name == "elt_multiply"
+          || name == "elt_divide" || name == "pow" || name == "fmin" || name == "fmax";
+      }
+
+      void index(pyro_ir_expr& e) const {
+        const pyro_ir_type& base = e.args_[0]->type_;
+        if (!base.shaped_ || base.extents_.size() < e.args_.size() - 1) return;
+        std::vector<pyro_ir_expr_ptr> extents;
+        for (size_t i = 1; i < e.args_.size(); ++i) {
+          const pyro_ir_expr& ix = *e.args_[i];
+          if (ix.kind_ == PYRO_IR_RANGE)
+            extents.push_back(range_extent(ix.args_[0], ix.args_[1], base.extents_[i - 1]));
+          else if (!ix.type_.shaped_ || ix.type_.extents_.size() > 1)
+            return;
+          else if (ix.type_.extents_.size() == 1)
+            extents.push_back(ix.type_.extents_[0]);
+        }
+        extents.insert(extents.end(), base.extents_.begin() + (e.args_.size() - 1),
+                       base.extents_.end());
+        shape(e, extents);
+      }
+
+      void infer(pyro_ir_expr& e) const {
+        const std::vector<pyro_ir_expr_ptr>& a = e.args_;
+        switch (e.kind_) {
+          case PYRO_IR_LITERAL:
+          case PYRO_IR_PYTHON:
+            shape(e, std::vector<pyro_ir_expr_ptr>());
+            return;
+          case PYRO_IR_VAR: {
+            std::map<std::string, pyro_ir_type>::const_iterator t = temps_.find(e.name_);
+            if (t != temps_.end()) e.type_ = t->second;
+            else if (e.type_.has_extents()) e.type_.shaped_ = true;
+            return;
+          }
+          case PYRO_IR_INDEX:
+            index(e);
+            return;
+          case PYRO_IR_SLICE: {
+            const pyro_ir_type& base = a[0]->type_;
+            if (!base.shaped_ || base.extents_.empty()) return;
+            std::vector<pyro_ir_expr_ptr> extents(base.extents_);
+            extents[0] = slice_extent(a[1], a[2]);
+            shape(e, extents);
+            return;
+          }
+          case PYRO_IR_RANGE:
+            // not a value; see index()
+            return;
+          case PYRO_IR_UNARY:
+            if (a[0]->type_.shaped_) shape(e, a[0]->type_.extents_);
+            return;
+          case PYRO_IR_BINARY:
+            broadcast(e, a[0]->type_, a[1]->type_);
+            return;
+          case PYRO_IR_CONDITIONAL:
+            if (pyro_ir_same_shape(a[1]->type_, a[2]->type_))
+              shape(e, a[1]->type_.extents_);
+            return;
+          case PYRO_IR_CALL: {
+            if (a.size() == 1 && is_pyro_elementwise_function(e.name_)) {
+              if (a[0]->type_.shaped_) shape(e, a[0]->type_.extents_);
+              return;
+            }
+            if (a.size() == 2 && is_elementwise_binary_function(e.name_)) {
+              broadcast(e, a[0]->type_, a[1]->type_);
+              return;
+            }
+            // other functions see the slices of a vectorized loop only
+            // through elementwise ones, so their Stan type holds
+            if (e.type_.is_scalar()) shape(e, std::vector<pyro_ir_expr_ptr>());
+            return;
+          }
+        }
+      }
+
+    public:
+      /**
+       * @return e and its operands annotated with their shapes
+       */
+      pyro_ir_expr_ptr infer(const pyro_ir_expr_ptr& e) const {
+        if (!e) return e;
+        std::shared_ptr<pyro_ir_expr> r(new pyro_ir_expr(*e));
+        for (size_t i = 0; i < r->args_.size(); ++i)
+          r->args_[i] = infer(r->args_[i]);
+        infer(*r);
+        return r;
+      }
+
+      void run(std::vector<pyro_ir_stmt_ptr>& ss) {
+        for (size_t i = 0; i < ss.size(); ++i) {
+          pyro_ir_stmt& x = *ss[i];
+          x.rhs_ = infer(x.rhs_);
+          x.lhs_ = infer(x.lhs_);
+          for (size_t j = 0; j < x.args_.size(); ++j)
+            x.args_[j] = infer(x.args_[j]);
+          if (x.kind_ == PYRO_IR_LET) {
+            temps_[x.lhs_->name_] = x.rhs_->type_;
+            x.lhs_ = infer(x.lhs_);
+          }
+          run(x.decls_);
+          run(x.body_);
+          for (size_t j = 0; j < x.bodies_.size(); ++j)
+            run(x.bodies_[j]);
+        }
+      }
+
+      void run(pyro_ir_program& ir) {
+        run(ir.transformed_data_);
+        run(ir.transformed_parameters_);
+        run(ir.model_);
+      }
+    };
+
+  }
+}
+#endif
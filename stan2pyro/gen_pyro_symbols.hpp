@@ -0,0 +1,180 @@
+#ifndef STAN2PYRO_GEN_PYRO_SYMBOLS_HPP
+#define STAN2PYRO_GEN_PYRO_SYMBOLS_HPP
+
+#include <stan/lang/ast.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/variant/apply_visitor.hpp>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace stan {
+  namespace lang {
+
+    /**
+     * Return the Python-safe spelling of a Stan identifier: Python
+     * keywords that are legal Stan identifiers get a trailing underscore.
+     *
+     * @param[in] name Stan identifier
+     * @return identifier to use in the generated Python
+     */
+    std::string safeguard_varname(const std::string& name) {
+      static const char* const keywords[] = {"False", "class", "finally", "is", "return", "None", "continue", "for",
+        "lambda", "try", "True", "def", "from", "nonlocal", "while", "and", "del", "global", "not", "with", "as",
+        "elif", "if", "or", "yield", "assert", "else", "import", "pass", "break", "except", "in", "raise"};
+      static const std::set<std::string> res_keys(keywords, keywords + sizeof(keywords) / sizeof(keywords[0]));
+      if (res_keys.find(name) != res_keys.end()) return name + "_";
+      else return name;
+    }
+
+    /**
+     * Return the Python name of the n-th temporary introduced by the
+     * optimization passes.  Stan identifiers start with a letter and
+     * safeguard_varname only appends to them, so the leading underscore
+     * keeps temporaries apart from program variables; the trailing
+     * double underscore keeps them apart from the run-time helpers such
+     * as _call_func and _as_tensor.
+     *
+     * @param[in] n number of the temporary
+     * @return identifier of the temporary
+     */
+    std::string pyro_temporary_name(size_t n) {
+      return "_t" + boost::lexical_cast<std::string>(n) + "__";
+    }
+
+    /**
+     * Return the Python name of the 0-based long tensor of positions
+     * prepared from an int data array that vectorized loops gather
+     * with, apart from program variables and helpers as for
+     * pyro_temporary_name.
+     *
+     * @param[in] py_name Python name of the int data array
+     * @return identifier of the positions
+     */
+    std::string pyro_gather_index_name(const std::string& py_name) {
+      return "_" + py_name + "_index__";
+    }
+
+    /**
+     * Program block a top-level variable or a statement is in.
+     */
+    enum pyro_block {
+      PYRO_DATA_BLOCK,
+      PYRO_TRANSFORMED_DATA_BLOCK,
+      PYRO_PARAMETER_BLOCK,
+      PYRO_TRANSFORMED_PARAMETER_BLOCK,
+      PYRO_MODEL_BLOCK,
+      /**
+       * Local variables and loop indices.
+       */
+      PYRO_LOCAL_BLOCK
+    };
+
+    /**
+     * Visitor returning the declaration fields shared by every
+     * variable declaration type.
+     */
+    struct base_var_decl_vis : public boost::static_visitor<const base_var_decl*> {
+      const base_var_decl* operator()(const nil& /*x*/) const { return 0; }
+
+      template <typename D>
+      const base_var_decl* operator()(const D& x) const { return &x; }
+    };
+
+    /**
+     * Entry of the symbol table: where a variable is declared, its
+     * declaration and its sanitized Python name.
+     */
+    struct pyro_symbol {
+      pyro_block block_;
+      const var_decl* decl_;
+      const base_var_decl* base_;
+      std::string py_name_;
+
+      pyro_symbol() : block_(PYRO_DATA_BLOCK), decl_(0), base_(0) { }
+
+      pyro_symbol(pyro_block block, const var_decl& decl)
+        : block_(block), decl_(&decl), py_name_(safeguard_varname(decl.name())) {
+        base_var_decl_vis vis;
+        base_ = boost::apply_visitor(vis, decl.decl_);
+      }
+
+      /**
+       * @return array dimensions of the declaration
+       */
+      const std::vector<expression>& dims() const { return base_->dims_; }
+
+      /**
+       * @return base type of the declaration (int, real, vector, ...)
+       */
+      const base_expr_type& base_type() const { return base_->base_type_; }
+
+      /**
+       * @return true if the variable is data or transformed data
+       */
+      bool is_data() const {
+        return block_ == PYRO_DATA_BLOCK || block_ == PYRO_TRANSFORMED_DATA_BLOCK;
+      }
+    };
+
+    /**
+     * Hashed lookup of the top-level variables of a program, built once
+     * after parsing.  Local variables and loop indices are not entered;
+     * lookups for them fall back to sanitizing the name.
+     */
+    class pyro_symbol_table {
+      boost::unordered_map<std::string, pyro_symbol> symbols_;
+
+      void add(const std::vector<var_decl>& decls, pyro_block block) {
+        for (size_t i = 0; i < decls.size(); ++i)
+          symbols_[decls[i].name()] = pyro_symbol(block, decls[i]);
+      }
+
+    public:
+      /**
+       * Construct the table for the specified program.  The program
+       * must outlive the table.
+       *
+       * @param[in] p parsed program
+       */
+      explicit pyro_symbol_table(const program& p) {
+        add(p.data_decl_, PYRO_DATA_BLOCK);
+        add(p.derived_data_decl_.first, PYRO_TRANSFORMED_DATA_BLOCK);
+        add(p.parameter_decl_, PYRO_PARAMETER_BLOCK);
+        add(p.derived_decl_.first, PYRO_TRANSFORMED_PARAMETER_BLOCK);
+      }
+
+      /**
+       * @param[in] name Stan identifier
+       * @return symbol for the identifier, or null if it is not a
+       * top-level variable
+       */
+      const pyro_symbol* find(const std::string& name) const {
+        boost::unordered_map<std::string, pyro_symbol>::const_iterator it
+          = symbols_.find(name);
+        return it == symbols_.end() ? 0 : &it->second;
+      }
+
+      /**
+       * @param[in] name Stan identifier
+       * @return identifier to use in the generated Python
+       */
+      std::string py_name(const std::string& name) const {
+        const pyro_symbol* sym = find(name);
+        return sym ? sym->py_name_ : safeguard_varname(name);
+      }
+
+      /**
+       * @param[in] name Stan identifier
+       * @return true if the identifier is data or transformed data
+       */
+      bool is_data(const std::string& name) const {
+        const pyro_symbol* sym = find(name);
+        return sym && sym->is_data();
+      }
+    };
+
+  }
+}
+#endif
@@ -0,0 +1,75 @@
+#ifndef STAN2PYRO_GEN_PYRO_TARGET_HPP
+#define STAN2PYRO_GEN_PYRO_TARGET_HPP
+
+#include <stan/lang/ast.hpp>
+#include <gen_pyro_context.hpp>
+#include <gen_pyro_ir.hpp>
+#include <string>
+#include <vector>
+
+namespace stan {
+  namespace lang {
+
+    /**
+     * Accumulation of the target.  The target increments of the model
+     * block add to one tensor, which a single pyro.factor site adds to
+     * the log joint at the end of the block:
+     *
+     *   for (n in 1:N) target += normal_lpdf(y[n] | mu[n], sigma);
+     *
+     *   _target__ = torch.zeros(())
+     *   _target__ = _target__ + dist.Normal(mu[0:to_int(N)], sigma).log_prob(y[0:to_int(N)]).sum()
+     *   pyro.factor("target", _target__)
+     *
+     * An increment by a tensor, such as that of a vectorized loop, adds
+     * its sum.  Runs after dead code elimination, which would drop the
+     * statements around the increments.
+     */
+    class pyro_target_accumulation {
+      /**
+       * Python name of the accumulator.  Stan identifiers start with a
+       * letter and run-time helpers do not end in a double underscore,
+       * as for pyro_temporary_name.
+       */
+      static std::string accumulator() {
+        return "_target__";
+      }
+
+      /**
+       * Make the target increments of ss add to the accumulator.
+       *
+       * @return true if ss has one
+       */
+      static bool accumulate(std::vector<pyro_ir_stmt_ptr>& ss) {
+        bool found = false;
+        for (size_t i = 0; i < ss.size(); ++i) {
+          pyro_ir_stmt& x = *ss[i];
+          if (x.kind_ == PYRO_IR_FACTOR) {
+            x.text_ = accumulator();
+            found = true;
+          }
+          found = accumulate(x.decls_) || found;
+          found = accumulate(x.body_) || found;
+          for (size_t j = 0; j < x.bodies_.size(); ++j)
+            found = accumulate(x.bodies_[j]) || found;
+        }
+        return found;
+      }
+
+      static pyro_ir_stmt_ptr verbatim(const std::string& text) {
+        pyro_ir_stmt_ptr s(new pyro_ir_stmt(PYRO_IR_VERBATIM, PYRO_MODEL_BLOCK, 0));
+        s->text_ = text;
+        return s;
+      }
+
+    public:
+      void run(pyro_ir_program& ir) {
+        if (!accumulate(ir.model_)) return;
+        ir.model_.insert(ir.model_.begin(), verbatim(accumulator() + " = torch.zeros(())"));
+        ir.model_.push_back(verbatim("pyro.factor(\"target\", " + accumulator() + ")"));
+      }
+    };
+
+  }
+}
+#endif
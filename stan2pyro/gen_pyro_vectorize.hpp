@@ -0,0 +1,804 @@
+#ifndef STAN2PYRO_GEN_PYRO_VECTORIZE_HPP
+#define STAN2PYRO_GEN_PYRO_VECTORIZE_HPP
+
+#include <stan/lang/ast.hpp>
+#include <gen_pyro_context.hpp>
+#include <gen_pyro_ir.hpp>
+#include <gen_pyro_distributions.hpp>
+#include <boost/lexical_cast.hpp>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace stan {
+  namespace lang {
+
+    /**
+     * How the value of an expression changes across the iterations of
+     * a for loop.
+     */
+    enum pyro_loop_dependence {
+      /**
+       * Same value in every iteration.
+       */
+      PYRO_LOOP_INVARIANT,
+      /**
+       * Iteration i only reads element i of arrays indexed by the loop
+       * variable, or the element of an invariant array at element i of
+       * an int data array, through operations that apply elementwise to
+       * tensors.
+       */
+      PYRO_LOOP_ELEMENTWISE,
+      /**
+       * Anything else, including every use of a variable the loop writes
+       * other than its own element.
+       */
+      PYRO_LOOP_OTHER
+    };
+
+    /**
+     * @return dependence of an expression combining operands of
+     * dependence a and b elementwise
+     */
+    pyro_loop_dependence pyro_join_dependence(pyro_loop_dependence a,
+                                              pyro_loop_dependence b) {
+      if (a == PYRO_LOOP_OTHER || b == PYRO_LOOP_OTHER) return PYRO_LOOP_OTHER;
+      if (a == PYRO_LOOP_ELEMENTWISE || b == PYRO_LOOP_ELEMENTWISE)
+        return PYRO_LOOP_ELEMENTWISE;
+      return PYRO_LOOP_INVARIANT;
+    }
+
+    /**
+     * @param[in] name Stan function name
+     * @return true if the unary function maps a tensor elementwise when
+     * generated through _call_func
+     */
+    bool is_pyro_elementwise_function(const std::string& name) {
+      static const char* const names[] = {"exp", "log", "log10", "log1p", "expm1",
+        "sqrt", "inv_logit", "Phi", "fabs", "sin", "cos", "tan", "sinh", "cosh",
+        "tanh", "asin", "acos", "atan", "floor", "ceil", "round"};
+      static const std::set<std::string> fns(names, names + sizeof(names) / sizeof(names[0]));
+      return fns.find(name) != fns.end();
+    }
+
+    /**
+     * @param[in] e expression
+     * @param[in] loop_var loop variable
+     * @return true if e is an element v[loop_var] of a variable v
+     */
+    bool is_pyro_loop_element(const pyro_ir_expr& e, const std::string& loop_var) {
+      return e.kind_ == PYRO_IR_INDEX && e.args_.size() == 2
+        && e.args_[0]->kind_ == PYRO_IR_VAR && !e.args_[0]->is_var(loop_var)
+        && e.args_[1] && e.args_[1]->is_var(loop_var);
+    }
+
+    /**
+     * @param[in] e expression
+     * @param[in] loop_var loop variable
+     * @return true if e is an element v[w[loop_var]] of a variable v,
+     * at the element of an int data array w
+     */
+    bool is_pyro_loop_gather(const pyro_ir_expr& e, const std::string& loop_var) {
+      if (e.kind_ != PYRO_IR_INDEX || e.args_.size() != 2 || e.args_[0]->kind_ != PYRO_IR_VAR
+          || !is_pyro_loop_element(*e.args_[1], loop_var))
+        return false;
+      const pyro_ir_expr& w = *e.args_[1]->args_[0];
+      return w.block_ == PYRO_DATA_BLOCK && w.type_.dtype() == PYRO_IR_INT
+        && w.type_.rank() == 1;
+    }
+
+    /**
+     * @param[in] e expression; may be null
+     * @param[in] loop_var loop variable
+     * @param[in] ix index
+     * @return e with every element v[loop_var] replaced by v[ix]
+     */
+    pyro_ir_expr_ptr pyro_index_loop_elements(const pyro_ir_expr_ptr& e,
+                                              const std::string& loop_var,
+                                              const pyro_ir_expr_ptr& ix) {
+      if (!e || e->args_.empty()) return e;
+      std::vector<pyro_ir_expr_ptr> args(e->args_);
+      if (is_pyro_loop_element(*e, loop_var)) {
+        args[1] = ix;
+      } else {
+        for (size_t i = 0; i < args.size(); ++i)
+          args[i] = pyro_index_loop_elements(args[i], loop_var, ix);
+      }
+      return pyro_ir_with_args(*e, args);
+    }
+
+    /**
+     * Classification of expressions with respect to one for loop.  The
+     * first construct found to be neither invariant nor elementwise is
+     * described in reason_.
+     */
+    struct pyro_loop_dependence_analysis {
+      /**
+       * Loop variable.
+       */
+      const std::string& loop_var_;
+
+      /**
+       * Variables written by the loop body.
+       */
+      const std::set<std::string>& written_vars_;
+
+      /**
+       * Enumerated latent variables sampled by the loop body, of which
+       * iteration i reads its own value (see pyro_mixture_enumeration).
+       */
+      std::set<std::string> latent_;
+
+      /**
+       * Why the expression is not elementwise; empty until it is known
+       * not to be.
+       */
+      std::string reason_;
+
+      pyro_loop_dependence_analysis(const std::string& loop_var,
+                                    const std::set<std::string>& written_vars)
+        : loop_var_(loop_var), written_vars_(written_vars) { }
+
+      pyro_loop_dependence other(const std::string& reason) {
+        if (reason_.empty()) reason_ = reason;
+        return PYRO_LOOP_OTHER;
+      }
+
+      /**
+       * @return invariant if every operand is, otherwise other
+       */
+      pyro_loop_dependence opaque(const pyro_ir_expr& e, const std::string& what) {
+        for (size_t i = 0; i < e.args_.size(); ++i)
+          if (dep(e.args_[i]) != PYRO_LOOP_INVARIANT)
+            return other(what + " depends on " + loop_var_);
+        return PYRO_LOOP_INVARIANT;
+      }
+
+      pyro_loop_dependence dep(const pyro_ir_expr_ptr& p) {
+        if (!p) return PYRO_LOOP_INVARIANT;
+        const pyro_ir_expr& e = *p;
+        switch (e.kind_) {
+          case PYRO_IR_LITERAL:
+            return PYRO_LOOP_INVARIANT;
+          case PYRO_IR_VAR:
+            if (e.name_ == loop_var_)
+              return other(loop_var_ + " is used as a value");
+            if (latent_.count(e.name_))
+              return PYRO_LOOP_ELEMENTWISE;
+            if (written_vars_.count(e.name_))
+              return other("reads " + e.name_ + ", written by the loop, other than at ["
+                           + loop_var_ + "]");
+            return PYRO_LOOP_INVARIANT;
+          case PYRO_IR_INDEX: {
+            if (is_pyro_loop_element(e, loop_var_)) {
+              if (e.type_.is_scalar())
+                return PYRO_LOOP_ELEMENTWISE;
+              return other(e.args_[0]->name_ + "[" + loop_var_ + "] is not a scalar");
+            }
+            // a gather, such as alpha[group[n]]
+            if (is_pyro_loop_gather(e, loop_var_)) {
+              if (!e.type_.is_scalar())
+                return other(e.args_[0]->name_ + "[" + e.args_[1]->args_[0]->name_ + "["
+                             + loop_var_ + "]] is not a scalar");
+              if (dep(e.args_[0]) == PYRO_LOOP_INVARIANT)
+                return PYRO_LOOP_ELEMENTWISE;
+              return other(e.args_[0]->name_ + ", indexed by a gathered index, depends on "
+                           + loop_var_);
+            }
+            // the element chosen by an enumerated latent variable
+            if (e.args_.size() == 2 && e.args_[1]->kind_ == PYRO_IR_VAR
+                && latent_.count(e.args_[1]->name_) && dep(e.args_[0]) == PYRO_LOOP_INVARIANT)
+              return PYRO_LOOP_ELEMENTWISE;
+            for (size_t i = 1; i < e.args_.size(); ++i) {
+              if (dep(e.args_[i]) != PYRO_LOOP_INVARIANT) {
+                reason_.clear();
+                return other("indexes " + (e.args_[0]->kind_ == PYRO_IR_VAR
+                                           ? e.args_[0]->name_
+                                           : std::string("an expression"))
+                             + " by an expression of " + loop_var_ + " other than ["
+                             + loop_var_ + "] alone");
+              }
+            }
+            return dep(e.args_[0]);
+          }
+          case PYRO_IR_SLICE:
+            return opaque(e, "slice");
+          case PYRO_IR_RANGE:
+            return opaque(e, "range");
+          case PYRO_IR_CALL: {
+            // _lp functions touch the target and _rng functions draw;
+            // hoisting either out of the loop would change what the
+            // program does
+            if (has_lp_suffix(e.name_) || has_rng_suffix(e.name_))
+              return other("calls " + e.name_ + ", which has side effects");
+            pyro_loop_dependence d = PYRO_LOOP_INVARIANT;
+            for (size_t i = 0; i < e.args_.size(); ++i)
+              d = pyro_join_dependence(d, dep(e.args_[i]));
+            if (d == PYRO_LOOP_ELEMENTWISE
+                && !(e.args_.size() == 1 && is_pyro_elementwise_function(e.name_)))
+              return other(e.name_ + " is not an elementwise function");
+            return d;
+          }
+          case PYRO_IR_BINARY:
+            if (e.name_ == "+" || e.name_ == "-" || e.name_ == "*" || e.name_ == "/")
+              return pyro_join_dependence(dep(e.args_[0]), dep(e.args_[1]));
+            return opaque(e, "operator " + e.name_);
+          case PYRO_IR_UNARY: {
+            pyro_loop_dependence d = dep(e.args_[0]);
+            if (e.name_ == "-" || e.name_ == "+" || d == PYRO_LOOP_INVARIANT) return d;
+            return other("operator " + e.name_ + " depends on " + loop_var_);
+          }
+          case PYRO_IR_CONDITIONAL:
+            return opaque(e, "conditional expression");
+          case PYRO_IR_PYTHON:
+            return opaque(e, e.name_);
+        }
+        return PYRO_LOOP_OTHER;
+      }
+    };
+
+    /**
+     * @param[in] rhs value assigned to acc
+     * @param[in] acc assigned variable or element
+     * @param[out] term position of the other operand in rhs
+     * @return Stan function reducing a vector of the other operands to
+     * the operand that gives the same value if rhs is acc op e for an
+     * associative op, such as sum for acc + e or log_sum_exp for
+     * log_sum_exp(acc, e), otherwise empty
+     */
+    std::string pyro_reduction_function(const pyro_ir_expr& rhs, const pyro_ir_expr_ptr& acc,
+                                        size_t& term) {
+      if ((rhs.kind_ != PYRO_IR_BINARY && rhs.kind_ != PYRO_IR_CALL) || rhs.args_.size() != 2
+          || (rhs.kind_ == PYRO_IR_CALL && rhs.user_defined_))
+        return "";
+      const std::string& op = rhs.name_;
+      std::string f;
+      bool commutes = true;
+      if (op == "+" || op == "add") {
+        f = "sum";
+      } else if (op == "-" || op == "subtract") {
+        f = "sum";
+        commutes = false;
+      } else if (op == "*" || op == "multiply") {
+        f = "prod";
+      } else if (rhs.kind_ == PYRO_IR_CALL && (op == "fmax" || op == "max")) {
+        f = "max";
+      } else if (rhs.kind_ == PYRO_IR_CALL && (op == "fmin" || op == "min")) {
+        f = "min";
+      } else if (rhs.kind_ == PYRO_IR_CALL && op == "log_sum_exp") {
+        f = "log_sum_exp";
+      } else {
+        return "";
+      }
+      if (pyro_ir_equal(rhs.args_[0], acc)) {
+        term = 1;
+        return f;
+      }
+      if (commutes && pyro_ir_equal(rhs.args_[1], acc)) {
+        term = 0;
+        return f;
+      }
+      return "";
+    }
+
+    /**
+     * Whether the iterations of a for loop are independent, so that the
+     * loop can run as whole-tensor operations over the index range.
+     * These loops qualify:
+     *
+     *   for (i in L:U) v[i] ~ dist(...);   // one batched sample in a pyro.plate
+     *   for (i in L:U) { v[i] = ...; w[i] = ...; }   // one assignment of v[L:U] per statement
+     *   for (i in L:U) target += ...;   // one increment by the sum over L:U
+     *   for (i in L:U) { z ~ categorical(theta); v[i] ~ dist(... mu[z] ...); }
+     *   for (i in L:U) s = s + ...;   // one update of s by the reduction over L:U
+     *
+     * The indexed variables must be real scalars or vectors, and every
+     * argument and right-hand side must be a scalar that is loop
+     * invariant or built from elements [i], and elements [w[i]] of
+     * invariant variables for int data w, with + - * /, unary minus
+     * and elementwise unary functions.  So must be a target increment,
+     * which must depend on i, or the arguments of the log density of a
+     * univariate distribution it computes.  Variables written by the
+     * loop may only be read at [i].  The last kind comes from an
+     * enumerated mixture (see pyro_mixture_enumeration): the latent
+     * variable z is drawn once per element, so the sample of v[i] may
+     * read it and the elements of invariant vectors it chooses.  In a
+     * reduction, s is a real variable or an element of one at loop
+     * invariant indexes, which the other operand may not read, and the
+     * update is one that pyro_reduction_function recognizes.
+     */
+    struct pyro_loop_analysis {
+      /**
+       * Statements of the loop body.
+       */
+      std::vector<pyro_ir_stmt_ptr> body_;
+
+      /**
+       * True if the body consists of sampling statements and assignments
+       * only, the loops this analysis targets.
+       */
+      bool candidate_;
+
+      /**
+       * Why the loop cannot be vectorized; empty if it can.
+       */
+      std::string reason_;
+
+      /**
+       * Stan function reducing the operands of a reduction loop (see
+       * pyro_reduction_function); empty for other loops.
+       */
+      std::string reduction_;
+
+      /**
+       * Position of the operand of a reduction in the right-hand side.
+       */
+      size_t term_;
+
+      /**
+       * @param[in] x for loop
+       */
+      explicit pyro_loop_analysis(const pyro_ir_stmt& x) : candidate_(true), term_(0) {
+        bool has_locals = false;
+        if (x.body_.size() == 1 && x.body_[0]->kind_ == PYRO_IR_BLOCK) {
+          body_ = x.body_[0]->body_;
+          has_locals = !x.body_[0]->decls_.empty();
+        } else {
+          body_ = x.body_;
+        }
+        size_t n_samples = 0;
+        std::set<std::string> written;
+        bool factor = body_.size() == 1 && body_[0]->kind_ == PYRO_IR_FACTOR;
+        bool mixture = body_.size() == 2 && body_[0]->enumerated_;
+        for (size_t i = 0; i < body_.size() && !factor; ++i) {
+          const pyro_ir_stmt& s = *body_[i];
+          if (s.kind_ != PYRO_IR_SAMPLE && s.kind_ != PYRO_IR_ASSIGN) {
+            candidate_ = false;
+            return;
+          }
+          if (s.kind_ == PYRO_IR_SAMPLE) ++n_samples;
+          if (const pyro_ir_expr* v = pyro_ir_base_var(s.lhs_))
+            written.insert(v->name_);
+        }
+        if (body_.empty()) {
+          candidate_ = false;
+        } else if (has_locals) {
+          reason_ = "the body declares local variables";
+        } else if (factor) {
+          check_factor(x.name_, *body_[0]);
+        } else if (mixture) {
+          check_mixture(x.name_, *body_[0], *body_[1], written);
+        } else if (n_samples > 0 && body_.size() > 1) {
+          reason_ = "the body is more than one sampling statement";
+        } else if (n_samples == 1) {
+          check_sample(x.name_, *body_[0], written);
+        } else if (body_.size() == 1 && !is_pyro_loop_element(*body_[0]->lhs_, x.name_)) {
+          check_reduction(x.name_, *body_[0], written);
+        } else {
+          for (size_t i = 0; i < body_.size() && reason_.empty(); ++i)
+            check_assignment(x.name_, *body_[i], written);
+        }
+      }
+
+      bool vectorizable() const {
+        return candidate_ && reason_.empty();
+      }
+
+      /**
+       * @param[in] latent enumerated latent variable the sample may
+       * read, or empty
+       */
+      void check_sample(const std::string& loop_var, const pyro_ir_stmt& s,
+                        const std::set<std::string>& written,
+                        const std::string& latent = "") {
+        if (s.truncated_) {
+          reason_ = "the sampling statement is truncated";
+          return;
+        }
+        std::set<std::string> none;
+        pyro_loop_dependence_analysis lhs(loop_var, none);
+        if (!s.lhs_ || !is_pyro_loop_element(*s.lhs_, loop_var)
+            || lhs.dep(s.lhs_) != PYRO_LOOP_ELEMENTWISE) {
+          reason_ = "the sampled expression is not a scalar v[" + loop_var + "]";
+          return;
+        }
+        pyro_loop_dependence_analysis args(loop_var, written);
+        if (!latent.empty()) args.latent_.insert(latent);
+        for (size_t i = 0; i < s.args_.size(); ++i) {
+          std::string arg = "argument " + boost::lexical_cast<std::string>(i + 1)
+            + " of " + s.name_;
+          if (!s.args_[i]->type_.is_scalar()) {
+            reason_ = arg + " is not a scalar";
+            return;
+          }
+          if (args.dep(s.args_[i]) == PYRO_LOOP_OTHER) {
+            reason_ = arg + ": " + args.reason_;
+            return;
+          }
+        }
+      }
+
+      void check_mixture(const std::string& loop_var, const pyro_ir_stmt& z,
+                         const pyro_ir_stmt& s, const std::set<std::string>& written) {
+        pyro_loop_dependence_analysis args(loop_var, written);
+        for (size_t i = 0; i < z.args_.size(); ++i) {
+          if (args.dep(z.args_[i]) != PYRO_LOOP_INVARIANT) {
+            reason_ = "the mixture weights depend on " + loop_var;
+            return;
+          }
+        }
+        if (s.kind_ != PYRO_IR_SAMPLE) {
+          reason_ = "the body is more than one sampling statement";
+          return;
+        }
+        check_sample(loop_var, s, written, z.lhs_->name_);
+      }
+
+      void check_reduction(const std::string& loop_var, const pyro_ir_stmt& a,
+                           const std::set<std::string>& written) {
+        const std::string& name = pyro_ir_base_var(a.lhs_)->name_;
+        std::set<std::string> none;
+        pyro_loop_dependence_analysis lhs(loop_var, none);
+        const pyro_ir_type& t = a.lhs_->type_;
+        std::string f = pyro_reduction_function(*a.rhs_, a.lhs_, term_);
+        if (!t.is_scalar() || t.dtype() != PYRO_IR_REAL
+            || lhs.dep(a.lhs_) != PYRO_LOOP_INVARIANT) {
+          reason_ = "the left-hand side " + name + " is not indexed by [" + loop_var
+            + "] alone, nor a real accumulator";
+          return;
+        }
+        if (f.empty()) {
+          reason_ = "the update of " + name + " is not a sum, product, maximum, minimum"
+            " or log_sum_exp of " + name + " and one operand";
+          return;
+        }
+        const pyro_ir_expr_ptr& e = a.rhs_->args_[term_];
+        if (!e->type_.is_scalar()) {
+          reason_ = "the operand of the reduction into " + name + " is not a scalar";
+          return;
+        }
+        if (pyro_ir_uses(e, name)) {
+          reason_ = "the operand of the reduction into " + name + " reads " + name;
+          return;
+        }
+        pyro_loop_dependence_analysis rhs(loop_var, written);
+        pyro_loop_dependence d = rhs.dep(e);
+        if (d == PYRO_LOOP_OTHER)
+          reason_ = "the operand of the reduction into " + name + ": " + rhs.reason_;
+        else if (d == PYRO_LOOP_INVARIANT)
+          reason_ = "the operand of the reduction into " + name + " does not depend on "
+            + loop_var;
+        else
+          reduction_ = f;
+      }
+
+      void check_factor(const std::string& loop_var, const pyro_ir_stmt& f) {
+        const pyro_ir_expr& e = *f.rhs_;
+        if (!e.type_.is_scalar()) {
+          reason_ = "the target increment is not a scalar";
+          return;
+        }
+        std::set<std::string> none;
+        pyro_loop_dependence_analysis rhs(loop_var, none);
+        pyro_loop_dependence d = PYRO_LOOP_INVARIANT;
+        const pyro_distribution_def* def = e.kind_ == PYRO_IR_CALL && !e.user_defined_
+          ? pyro_density_distribution(e.name_, pyro_ir_types(e.args_)) : 0;
+        if (def && def->univariate_) {
+          // the log density of a batch is the sum of those of its
+          // elements
+          for (size_t i = 0; i < e.args_.size() && d != PYRO_LOOP_OTHER; ++i)
+            d = e.args_[i]->type_.is_scalar()
+              ? pyro_join_dependence(d, rhs.dep(e.args_[i]))
+              : rhs.other("argument " + boost::lexical_cast<std::string>(i + 1)
+                          + " of " + e.name_ + " is not a scalar");
+        } else {
+          d = rhs.dep(f.rhs_);
+        }
+        if (d == PYRO_LOOP_OTHER)
+          reason_ = "the target increment: " + rhs.reason_;
+        else if (d == PYRO_LOOP_INVARIANT)
+          reason_ = "the target increment does not depend on " + loop_var;
+      }
+
+      void check_assignment(const std::string& loop_var, const pyro_ir_stmt& a,
+                            const std::set<std::string>& written) {
+        const pyro_ir_expr* v = pyro_ir_base_var(a.lhs_);
+        const std::string& name = v->name_;
+        if (!is_pyro_loop_element(*a.lhs_, loop_var)) {
+          reason_ = "the left-hand side " + name + " is not indexed by ["
+            + loop_var + "] alone";
+          return;
+        }
+        const expr_type& t = v->type_.stan_;
+        if (!(t.num_dims_ == 1 && t.base_type_.is_double_type())
+            && !(t.num_dims_ == 0
+                 && (t.base_type_.is_vector_type() || t.base_type_.is_row_vector_type()))) {
+          reason_ = name + " is not a real array or vector";
+          return;
+        }
+        if (!a.rhs_->type_.is_scalar()) {
+          reason_ = "the value assigned to " + name + " is not a scalar";
+          return;
+        }
+        pyro_loop_dependence_analysis rhs(loop_var, written);
+        if (rhs.dep(a.rhs_) == PYRO_LOOP_OTHER)
+          reason_ = "the value assigned to " + name + ": " + rhs.reason_;
+      }
+    };
+
+    /**
+     * Pass rewriting loops whose iterations are independent (see
+     * pyro_loop_analysis) as whole-tensor operations on the slice
+     * [lo:hi] of their index range.  A sampling statement becomes one
+     * batched sample in a pyro.plate,
+     *
+     *   for (n in 1:N) y[n] ~ normal(mu[n], sigma);
+     *
+     *   with pyro.plate("y_plate1", to_int(N)):
+     *       y[0:to_int(N)] =  pyro.sample("y[%d:%d]" % (0,to_int(N)), ...
+     *
+     * and each assignment one assignment of the slice.  With the
+     * subsample option, the plate of an observation over the rows of
+     * the data, for (n in 1:N) y[n] ~ ... with N the first extent of
+     * y, draws mini-batches instead, which Pyro scales to an unbiased
+     * estimate of the likelihood; elements [n] become gathers at the
+     * positions of the batch.
+     *
+     *   with pyro.plate("y_plate1", to_int(N), subsample_size=100) as _t1__:
+     *       y[(_t1__).long()] =  pyro.sample("y[_t1__ + 1]", dist.Normal(mu[(_t1__).long()], ...
+     *
+     *
+     *   for (n in 1:N) mu[n] = alpha + beta * x[n];
+     *
+     *   mu[0:to_int(N)] = _pyro_assign(mu[0:to_int(N)], (alpha + (beta * x[0:to_int(N)])))
+     *
+     * A target increment becomes one increment by the slice, which the
+     * accumulator sums (see pyro_target_accumulation).
+     *
+     * Elements at the elements of int data arrays, as in hierarchical
+     * models, become one gather over the slice.  The data preparation
+     * converts the int array to 0-based positions once (see
+     * pyro_gather_index_name):
+     *
+     *   for (n in 1:N) y[n] ~ normal(alpha[group[n]], sigma);
+     *
+     *   with pyro.plate("y_plate1", to_int(N)):
+     *       y[0:to_int(N)] =  pyro.sample(..., dist.Normal(alpha[_group_index__[0:to_int(N)].long()], sigma), ...
+     *
+     * An accumulation loop becomes one update of the accumulator by the
+     * reduction of the slice of its operand:
+     *
+     *   for (n in 1:N) s = s + x[n] * w[n];
+     *
+     *   s = _pyro_assign(s, (s + torch.sum((x[0:to_int(N)] * w[0:to_int(N)]))))
+     *
+     * The maximum and minimum of nothing are undefined, so unless the
+     * bounds are literals the update of those is conditional on the
+     * range being non-empty.
+     *
+     * Candidate loops left as they are get a note saying why.
+     */
+    class pyro_loop_vectorizer {
+      pyro_codegen_context& ctx_;
+
+      /**
+       * Number of plates generated so far; numbers plate names.
+       */
+      int n_plates_;
+
+      /**
+       * @return the elements of v the iterations read: the slice
+       * v[lo:hi], or v at the positions of a mini-batch if batch is
+       * not null
+       */
+      static pyro_ir_expr_ptr rows(const pyro_ir_expr_ptr& v, const pyro_ir_expr_ptr& lo,
+                                   const pyro_ir_expr_ptr& hi, const pyro_ir_expr_ptr& batch) {
+        std::vector<pyro_ir_expr_ptr> args(1, v);
+        if (batch) {
+          args.push_back(pyro_ir_binary("+", batch, pyro_ir_int(1), batch->type_));
+          return pyro_ir_node(PYRO_IR_INDEX, "", args, pyro_ir_type(v->type_.stan_));
+        }
+        args.push_back(lo);
+        args.push_back(hi);
+        return pyro_ir_node(PYRO_IR_SLICE, "", args, v->type_);
+      }
+
+      /**
+       * @return e with every element v[loop_var] replaced by the
+       * elements of v the iterations read, and every element
+       * v[w[loop_var]] by v at those elements of w (see rows)
+       */
+      pyro_ir_expr_ptr slice(const pyro_ir_expr_ptr& e, const std::string& loop_var,
+                             const pyro_ir_expr_ptr& lo, const pyro_ir_expr_ptr& hi,
+                             const pyro_ir_expr_ptr& batch) {
+        if (!e) return e;
+        if (is_pyro_loop_element(*e, loop_var))
+          return rows(e->args_[0], lo, hi, batch);
+        if (is_pyro_loop_gather(*e, loop_var)) {
+          const pyro_ir_expr& w = *e->args_[1]->args_[0];
+          ctx_.gather_indexes_.insert(w.name_);
+          std::shared_ptr<pyro_ir_expr> positions(new pyro_ir_expr(w));
+          positions->name_ = positions->text_ = pyro_gather_index_name(w.text_);
+          pyro_ir_expr_ptr ix = rows(positions, lo, hi, batch);
+          std::vector<pyro_ir_expr_ptr> args;
+          args.push_back(e->args_[0]);
+          args.push_back(pyro_ir_binary("+", ix, pyro_ir_int(1), ix->type_));
+          return pyro_ir_node(PYRO_IR_INDEX, "", args, pyro_ir_type(e->args_[0]->type_.stan_));
+        }
+        if (e->args_.empty()) return e;
+        std::vector<pyro_ir_expr_ptr> args;
+        for (size_t i = 0; i < e->args_.size(); ++i)
+          args.push_back(slice(e->args_[i], loop_var, lo, hi, batch));
+        return pyro_ir_with_args(*e, args);
+      }
+
+      /**
+       * @return true if the vectorized loop x, with statements body,
+       * observes every row of a data variable, which it may then
+       * observe in mini-batches
+       */
+      bool subsampled(const pyro_ir_stmt& x, const std::vector<pyro_ir_stmt_ptr>& body) const {
+        if (ctx_.options_.subsample_ == 0 || body.back()->kind_ != PYRO_IR_SAMPLE
+            || !x.args_[0]->is_int_literal() || x.args_[0]->value_ != 1)
+          return false;
+        const pyro_ir_expr* y = pyro_ir_base_var(body.back()->lhs_);
+        return (y->block_ == PYRO_DATA_BLOCK || y->block_ == PYRO_TRANSFORMED_DATA_BLOCK)
+          && !y->type_.extents_.empty() && pyro_ir_same_extent(x.args_[1], y->type_.extents_[0]);
+      }
+
+      /**
+       * @param[in] x for loop
+       * @param[out] lo 0-based start of the slice of its index range
+       * @param[out] hi its end
+       * @param[out] size its length
+       * @return false if the loop is empty for literal bounds
+       */
+      static bool index_range(const pyro_ir_stmt& x, pyro_ir_expr_ptr& lo, pyro_ir_expr_ptr& hi,
+                              pyro_ir_expr_ptr& size) {
+        const pyro_ir_expr_ptr& low = x.args_[0];
+        const pyro_ir_expr_ptr& high = x.args_[1];
+        bool int_l = low->is_int_literal(), int_h = high->is_int_literal();
+        long l = static_cast<long>(low->value_), h = static_cast<long>(high->value_);
+        hi = int_h ? high : pyro_ir_python("to_int", high);
+        lo = int_l ? pyro_ir_int(l - 1)
+          : pyro_ir_binary("-", pyro_ir_python("to_int", low), pyro_ir_int(1), hi->type_);
+        if (int_l && int_h) {
+          if (h - l + 1 <= 0) return false;
+          size = pyro_ir_int(h - l + 1);
+        } else if (int_l && l == 1) {
+          size = hi;
+        } else {
+          std::vector<pyro_ir_expr_ptr> args;
+          args.push_back(pyro_ir_int(0));
+          args.push_back(pyro_ir_binary("-", hi, lo, hi->type_));
+          size = pyro_ir_python("max", args);
+        }
+        return true;
+      }
+
+      /**
+       * @param[in] x vectorizable for loop
+       * @param[in] body its statements
+       * @param[out] out replacement statements
+       * @return false, leaving out as it is, if the loop is empty for
+       * literal bounds
+       */
+      bool vectorize(const pyro_ir_stmt& x, const std::vector<pyro_ir_stmt_ptr>& body,
+                     std::vector<pyro_ir_stmt_ptr>& out) {
+        pyro_ir_expr_ptr lo, hi, size;
+        if (!index_range(x, lo, hi, size)) return false;
+        // the 0-based positions of a mini-batch
+        std::shared_ptr<pyro_ir_expr> batch;
+        if (subsampled(x, body)) {
+          batch.reset(new pyro_ir_expr(PYRO_IR_VAR));
+          batch->name_ = batch->text_ = ctx_.temporary();
+          batch->type_ = pyro_ir_type(expr_type(base_expr_type(int_type()), 1));
+        }
+        std::vector<pyro_ir_stmt_ptr> sliced;
+        for (size_t i = 0; i < body.size(); ++i) {
+          pyro_ir_stmt_ptr s(new pyro_ir_stmt(*body[i]));
+          s->lhs_ = slice(s->lhs_, x.name_, lo, hi, batch);
+          s->rhs_ = slice(s->rhs_, x.name_, lo, hi, batch);
+          for (size_t j = 0; j < s->args_.size(); ++j)
+            s->args_[j] = slice(s->args_[j], x.name_, lo, hi, batch);
+          sliced.push_back(s);
+        }
+        if (sliced[0]->kind_ == PYRO_IR_SAMPLE) {
+          // named after the observed variable of a mixture
+          pyro_ir_stmt_ptr plate(new pyro_ir_stmt(PYRO_IR_PLATE, x.block_, x.line_));
+          plate->name_ = pyro_ir_base_var(sliced.back()->lhs_)->name_ + "_plate"
+            + boost::lexical_cast<std::string>(++n_plates_);
+          plate->args_.push_back(size);
+          if (batch) {
+            plate->lhs_ = batch;
+            plate->args_.push_back(pyro_ir_int(long(ctx_.options_.subsample_)));
+            ++ctx_.stats_.subsampled_;
+          }
+          plate->body_ = sliced;
+          out.push_back(plate);
+        } else {
+          out.insert(out.end(), sliced.begin(), sliced.end());
+        }
+        return true;
+      }
+
+      /**
+       * @param[in] x vectorizable reduction loop
+       * @param[in] loop its analysis
+       * @param[out] out replacement statement, one update of the
+       * accumulator by the reduction of the slice of the operands
+       * @return false, leaving out as it is, if the loop is empty for
+       * literal bounds
+       */
+      bool reduce(const pyro_ir_stmt& x, const pyro_loop_analysis& loop,
+                  std::vector<pyro_ir_stmt_ptr>& out) {
+        pyro_ir_expr_ptr lo, hi, size;
+        if (!index_range(x, lo, hi, size)) return false;
+        const pyro_ir_stmt& a = *loop.body_[0];
+        const pyro_ir_expr_ptr& e = a.rhs_->args_[loop.term_];
+        // the slice of a scalar operand is an array, as the reduction
+        // functions expect
+        std::shared_ptr<pyro_ir_expr> terms(new pyro_ir_expr(*slice(e, x.name_, lo, hi,
+                                                                      pyro_ir_expr_ptr())));
+        if (terms->type_.is_scalar())
+          terms->type_ = pyro_ir_type(expr_type(e->type_.stan_.base_type_, 1));
+        std::vector<pyro_ir_expr_ptr> args(a.rhs_->args_);
+        args[loop.term_] = pyro_ir_node(PYRO_IR_CALL, loop.reduction_,
+                                        std::vector<pyro_ir_expr_ptr>(1, terms), a.lhs_->type_);
+        pyro_ir_expr_ptr rhs = pyro_ir_with_args(*a.rhs_, args);
+        // torch has no maximum or minimum of nothing, unlike the other
+        // reductions, which are the identity of their update
+        bool nonempty = x.args_[0]->is_int_literal() && x.args_[1]->is_int_literal();
+        if ((loop.reduction_ == "max" || loop.reduction_ == "min") && !nonempty) {
+          std::vector<pyro_ir_expr_ptr> cond(x.args_.begin(), x.args_.begin() + 2);
+          std::vector<pyro_ir_expr_ptr> branches;
+          branches.push_back(pyro_ir_node(PYRO_IR_CALL, "logical_lte", cond,
+                                          pyro_ir_type(expr_type(base_expr_type(int_type()), 0))));
+          branches.push_back(rhs);
+          branches.push_back(a.lhs_);
+          rhs = pyro_ir_node(PYRO_IR_CONDITIONAL, "", branches, a.lhs_->type_);
+        }
+        pyro_ir_stmt_ptr s(new pyro_ir_stmt(a));
+        s->rhs_ = rhs;
+        out.push_back(s);
+        ++ctx_.stats_.reduced_;
+        return true;
+      }
+
+    public:
+      explicit pyro_loop_vectorizer(pyro_codegen_context& ctx)
+        : ctx_(ctx), n_plates_(0) { }
+
+      void run(std::vector<pyro_ir_stmt_ptr>& ss) {
+        std::vector<pyro_ir_stmt_ptr> out;
+        for (size_t i = 0; i < ss.size(); ++i) {
+          pyro_ir_stmt& x = *ss[i];
+          if (x.kind_ == PYRO_IR_FOR) {
+            pyro_loop_analysis loop(x);
+            if (loop.vectorizable()
+                && (loop.reduction_.empty() ? vectorize(x, loop.body_, out)
+                    : reduce(x, loop, out)))
+              continue;
+            if (loop.candidate_ && !loop.reason_.empty())
+              ctx_.notes_.push_back("line " + boost::lexical_cast<std::string>(x.line_)
+                                    + ": loop over " + x.name_ + " not vectorized: "
+                                    + loop.reason_);
+          }
+          run(x.body_);
+          for (size_t j = 0; j < x.bodies_.size(); ++j)
+            run(x.bodies_[j]);
+          out.push_back(ss[i]);
+        }
+        ss.swap(out);
+      }
+
+      void run(pyro_ir_program& ir) {
+        run(ir.transformed_data_);
+        run(ir.transformed_parameters_);
+        run(ir.model_);
+      }
+    };
+
+  }
+}
+#endif
@@ -0,0 +1,140 @@
+#ifndef STAN2PYRO_GEN_PYRO_ZERO_BASED_HPP
+#define STAN2PYRO_GEN_PYRO_ZERO_BASED_HPP
+
+#include <stan/lang/ast.hpp>
+#include <gen_pyro_context.hpp>
+#include <gen_pyro_ir.hpp>
+#include <string>
+#include <vector>
+
+namespace stan {
+  namespace lang {
+
+    /**
+     * Zero-based loop normalization.  A for loop whose variable is only
+     * used to index, directly or with a constant offset, runs over the
+     * 0-based indexes instead, so that its accesses need no "- 1":
+     *
+     *   for (n in 1:N) y[n] ~ normal(mu[n], sigma);
+     *
+     *   for n in range(0, to_int(N)):
+     *       y[n] =  pyro.sample("y[%d]" % (n), dist.Normal(mu[n], sigma) ...
+     *
+     * The body reads the variable as n + 1, whose constant the printer
+     * folds into each index.  Any other use, such as a value, a bound
+     * or an extent, would pay for the shift instead, so such loops stay
+     * as they are.  So do loops declaring locals whose sizes or bounds
+     * read the variable, as ragged arrays do.
+     */
+    class pyro_zero_based_loops {
+      pyro_codegen_context& ctx_;
+
+      /**
+       * Loop variable being considered.
+       */
+      std::string var_;
+
+      /**
+       * Its uses as an index and otherwise.
+       */
+      size_t index_uses_, value_uses_;
+
+      void count(const pyro_ir_expr_ptr& e, bool is_index) {
+        if (!e) return;
+        if (e->is_var(var_)) {
+          ++(is_index ? index_uses_ : value_uses_);
+          return;
+        }
+        // i + c and i - c index as well as i does
+        bool offset = is_index && e->kind_ == PYRO_IR_BINARY
+          && (e->name_ == "+" || e->name_ == "-") && e->args_[1]->is_int_literal();
+        for (size_t i = 0; i < e->args_.size(); ++i) {
+          bool ix = false;
+          if (e->kind_ == PYRO_IR_INDEX)
+            ix = i > 0 && e->args_[i] && e->args_[i]->type_.is_scalar();
+          else if (e->kind_ == PYRO_IR_RANGE || offset)
+            ix = i == 0;
+          count(e->args_[i], ix);
+        }
+      }
+
+      void count(const std::vector<pyro_ir_stmt_ptr>& ss) {
+        for (size_t i = 0; i < ss.size(); ++i) {
+          const pyro_ir_stmt& x = *ss[i];
+          if (x.kind_ == PYRO_IR_DECL) {
+            // a declaration prints its text from the Stan program, which
+            // the shift cannot rewrite, such as vector[len[j]] v
+            for (size_t j = 0; j < x.args_.size(); ++j)
+              if (pyro_ir_uses(x.args_[j], var_)) ++value_uses_;
+            continue;
+          }
+          count(x.lhs_, false);
+          count(x.rhs_, false);
+          for (size_t j = 0; j < x.args_.size(); ++j)
+            count(x.args_[j], false);
+          count(x.decls_);
+          count(x.body_);
+          for (size_t j = 0; j < x.bodies_.size(); ++j)
+            count(x.bodies_[j]);
+        }
+      }
+
+      /**
+       * @return e reading the loop variable as var_ + 1
+       */
+      pyro_ir_expr_ptr shift(const pyro_ir_expr_ptr& e) const {
+        if (!e) return e;
+        if (e->is_var(var_)) return pyro_ir_binary("+", e, pyro_ir_int(1), e->type_);
+        if (e->args_.empty()) return e;
+        std::vector<pyro_ir_expr_ptr> args;
+        for (size_t i = 0; i < e->args_.size(); ++i)
+          args.push_back(shift(e->args_[i]));
+        return pyro_ir_with_args(*e, args);
+      }
+
+      void shift(std::vector<pyro_ir_stmt_ptr>& ss) const {
+        for (size_t i = 0; i < ss.size(); ++i) {
+          pyro_ir_stmt& x = *ss[i];
+          x.lhs_ = shift(x.lhs_);
+          x.rhs_ = shift(x.rhs_);
+          for (size_t j = 0; j < x.args_.size(); ++j)
+            x.args_[j] = shift(x.args_[j]);
+          shift(x.decls_);
+          shift(x.body_);
+          for (size_t j = 0; j < x.bodies_.size(); ++j)
+            shift(x.bodies_[j]);
+        }
+      }
+
+    public:
+      explicit pyro_zero_based_loops(pyro_codegen_context& ctx)
+        : ctx_(ctx), index_uses_(0), value_uses_(0) { }
+
+      void run(std::vector<pyro_ir_stmt_ptr>& ss) {
+        for (size_t i = 0; i < ss.size(); ++i) {
+          pyro_ir_stmt& x = *ss[i];
+          run(x.decls_);
+          run(x.body_);
+          for (size_t j = 0; j < x.bodies_.size(); ++j)
+            run(x.bodies_[j]);
+          if (x.kind_ != PYRO_IR_FOR) continue;
+          var_ = x.name_;
+          index_uses_ = value_uses_ = 0;
+          count(x.body_);
+          if (index_uses_ == 0 || value_uses_ > 0) continue;
+          shift(x.body_);
+          x.zero_based_ = true;
+          ++ctx_.stats_.rebased_;
+        }
+      }
+
+      void run(pyro_ir_program& ir) {
+        run(ir.transformed_data_);
+        run(ir.transformed_parameters_);
+        run(ir.model_);
+      }
+    };
+
+  }
+}
+#endif
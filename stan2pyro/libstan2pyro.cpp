@@ -0,0 +1,824 @@
+#include <stan/version.hpp>
+#include <stan/lang/compiler.hpp>
+#include <stan/lang/ast.hpp>
+#include <gen_pyro_symbols.hpp>
+#include <gen_pyro_context.hpp>
+#include <gen_pyro_ir.hpp>
+#include <gen_pyro_lower.hpp>
+#include <gen_pyro_fold.hpp>
+#include <gen_pyro_enumerate.hpp>
+#include <gen_pyro_vectorize.hpp>
+#include <gen_pyro_cse.hpp>
+#include <gen_pyro_licm.hpp>
+#include <gen_pyro_dce.hpp>
+#include <gen_pyro_target.hpp>
+#include <gen_pyro_shapes.hpp>
+#include <gen_pyro_zero_based.hpp>
+#include <gen_pyro_bounds.hpp>
+#include <gen_pyro_printer.hpp>
+#include <pyro_compile_cache.hpp>
+#include <pyro_compiler.hpp>
+#include <stan2pyro.h>
+#include <stan/lang/ast/node/expression.hpp>
+#include <stan/lang/generator/generate_indent.hpp>
+#include <stan/lang/ast/node/var_decl.hpp>
+#include <stan/lang/ast/node/vector_var_decl.hpp>
+#include <stan/lang/generator/has_lb.hpp>
+#include <stan/lang/generator/has_lub.hpp>
+#include <stan/lang/generator/has_ub.hpp>
+
+#include <boost/variant/apply_visitor.hpp>
+#include <ostream>
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+
+namespace stan {
+  namespace lang {
+
+    /**
+     * Readers-writer lock serializing the parts of Stan's parser that
+     * are not thread-safe.  Grammars and their variable maps are built
+     * per parse, but user-defined function signatures are registered in
+     * the process-wide function_signatures singleton, which code
+     * generation reads back.  Programs without a functions block only
+     * read the singleton and are compiled concurrently; programs that
+     * declare functions are compiled alone.
+     */
+    class pyro_parser_lock {
+      std::mutex mutex_;
+      std::condition_variable cv_;
+      int readers_;
+      bool writer_;
+
+      // the signatures singleton is built lazily on first use, which is
+      // not thread-safe; build it while the lock itself is initialized
+      pyro_parser_lock() : readers_(0), writer_(false) {
+        function_signatures::instance();
+      }
+
+    public:
+      static pyro_parser_lock& instance() {
+        static pyro_parser_lock lock;
+        return lock;
+      }
+
+      void lock(bool exclusive) {
+        std::unique_lock<std::mutex> l(mutex_);
+        if (exclusive) {
+          cv_.wait(l, [this] { return !writer_ && readers_ == 0; });
+          writer_ = true;
+        } else {
+          cv_.wait(l, [this] { return !writer_; });
+          ++readers_;
+        }
+      }
+
+      void unlock(bool exclusive) {
+        std::lock_guard<std::mutex> l(mutex_);
+        if (exclusive) writer_ = false;
+        else --readers_;
+        cv_.notify_all();
+      }
+    };
+
+    /**
+     * Holds the parser lock from parsing until code generation is done.
+     * An exclusive holder drops the signatures its program registered,
+     * so they do not leak into the next program of a batch.
+     */
+    class pyro_parser_guard {
+      bool locked_;
+      bool exclusive_;
+
+    public:
+      pyro_parser_guard() : locked_(false), exclusive_(false) { }
+
+      void lock(bool exclusive) {
+        pyro_parser_lock::instance().lock(exclusive);
+        locked_ = true;
+        exclusive_ = exclusive;
+      }
+
+      ~pyro_parser_guard() {
+        if (!locked_) return;
+        if (exclusive_) {
+          function_signatures::reset_sigs();
+          function_signatures::instance();
+        }
+        pyro_parser_lock::instance().unlock(exclusive_);
+      }
+    };
+
+    /**
+     * Conservative test for a functions block: true if the keyword is
+     * followed by an opening brace anywhere, comments included.
+     *
+     * @param[in] s include-expanded program text
+     * @return true if the program may declare functions
+     */
+    bool declares_functions(const std::string& s) {
+      static const std::string keyword = "functions";
+      for (size_t pos = s.find(keyword); pos != std::string::npos;
+           pos = s.find(keyword, pos + 1)) {
+        if (pos > 0 && (std::isalnum(s[pos - 1]) || s[pos - 1] == '_'))
+          continue;
+        size_t next = s.find_first_not_of(" \t\r\n", pos + keyword.size());
+        if (next != std::string::npos && s[next] == '{')
+          return true;
+      }
+      return false;
+    }
+
+    /**
+     * Parse and type check a Stan program into its AST.  Unlike
+     * stan::lang::compile, no C++ is generated.
+     *
+     * @param[in,out] msgs stream for parser warnings and errors
+     * @param[in] reader include-expanded Stan program
+     * @param[out] prog parsed program
+     * @param[in] name model name
+     * @param[out] timings parse phase timing
+     * @param[in,out] guard parser lock, acquired before parsing; hold it
+     * until code generation for prog is done
+     * @return true if the program parsed and type checked
+     */
+    bool parse_ast(std::ostream* msgs, const io::program_reader& reader,
+                   program& prog, const std::string& name,
+                   pyro_phase_timings& timings, pyro_parser_guard& guard,
+                   const bool allow_undefined = false) {
+      std::string s = reader.program();
+      std::stringstream ss(s);
+      guard.lock(declares_functions(s));
+      pyro_clock::time_point start = pyro_clock::now();
+      bool parse_succeeded = parse(msgs, ss, name, reader, prog,
+                                   allow_undefined);
+      timings.parse_ms_ = elapsed_ms(start);
+      return parse_succeeded;
+    }
+
+    std::string get_dims(const std::vector<expression>& dims,
+                         const pyro_codegen_context& ctx)  {
+        std::stringstream ss;
+        //ss<<"(";
+        int n_dims = dims.size();
+        if (n_dims==0){
+            return "";
+        }
+        for (int i=0;i<n_dims;i++){
+            pyro_generate_expression_as_index(dims[i], NOT_USER_FACING, ctx, ss);
+            if (i !=n_dims-1)
+                ss<< ", ";
+        }
+        //ss<<")";
+        return ss.str();
+        //return ", dims=(" +ss.str() + ")";
+    }
+
+    struct pyro_init_visgen : public visgen {
+      size_t indent_;
+      std::string var_name_;
+      bool use_cache_;
+      const pyro_codegen_context& ctx_;
+      explicit pyro_init_visgen (size_t indent, std::ostream& o, std::string var_name, bool use_cache,
+                                 const pyro_codegen_context& ctx)
+        : visgen(o), indent_(indent), var_name_(var_name), use_cache_(use_cache), ctx_(ctx) {  }
+
+      template <typename D>
+      std::string function_args(const D& x) const {
+        std::stringstream ss;
+        if (has_lub(x)) {
+          ss<<", low=";
+          pyro_generate_expression_as_index(x.range_.low_.expr_, NOT_USER_FACING, ctx_, ss);
+          ss << ", high=";
+          pyro_generate_expression_as_index(x.range_.high_.expr_, NOT_USER_FACING, ctx_, ss);
+        } else if (has_lb(x)) {
+          ss<<", low=";
+          pyro_generate_expression_as_index(x.range_.low_.expr_, NOT_USER_FACING, ctx_, ss);
+        } else if (has_ub(x)) {
+          ss << ", high=";
+          pyro_generate_expression_as_index(x.range_.high_.expr_, NOT_USER_FACING, ctx_, ss);
+        } else {
+          ss<<"";
+        }
+        return ss.str();
+      }
+
+
+
+      void operator()(const double_var_decl& x) const {
+        int n_dims = x.dims_.size();
+        o_<<"init_real";
+        if (use_cache_) o_<<"_and_cache";
+        o_<<"(\""<< var_name_ <<"\""<<function_args(x);
+        std::string str_dims = get_dims(x.dims_, ctx_);
+        if (str_dims != "") o_<<", dims=("<<str_dims <<")";
+        o_ << ") # real/double";
+        o_<<std::endl;
+      }
+      void operator()(const nil& /*x*/) const { }  // dummy
+
+      void operator()(const int_var_decl& x) const {
+        int n_dims = x.dims_.size();
+        o_<<"init_int";
+        if (use_cache_) o_<<"_and_cache";
+        o_<<"(\""<< var_name_ <<"\""<<function_args(x);
+        std::string str_dims = get_dims(x.dims_, ctx_);
+        if (str_dims != "") o_<<", dims=("<<str_dims <<")";
+        o_ << ") # real/double";
+        o_<<std::endl;
+      }
+
+      void operator()(const vector_var_decl& x) const {
+        o_<<"init_vector";
+        if (use_cache_) o_<<"_and_cache";
+        o_<<"(\""<< var_name_ <<"\""<<function_args(x)<<", dims=(";
+        std::string str_dims = get_dims(x.dims_, ctx_);
+        if (str_dims != "") o_<<str_dims<<", ";
+        pyro_generate_expression_as_index(x.M_, NOT_USER_FACING, ctx_, o_);
+        o_<<")) # vector";
+        o_<<std::endl;
+      }
+
+      void operator()(const row_vector_var_decl& x) const {
+        throw pyro_unsupported_error("row_vector_var_decl");
+      }
+
+      void operator()(const matrix_var_decl& x) const {
+        o_<<"init_matrix";
+        if (use_cache_) o_<<"_and_cache";
+        o_<<"(\""<< var_name_ <<"\""<<function_args(x)<<", dims=(";
+        std::string str_dims = get_dims(x.dims_, ctx_);
+        if (str_dims != "") o_<<str_dims<<", ";
+        pyro_generate_expression_as_index(x.M_, NOT_USER_FACING, ctx_, o_);
+        o_<<", ";
+        pyro_generate_expression_as_index(x.N_, NOT_USER_FACING, ctx_, o_);
+
+        o_<<")) # matrix";
+        o_<<std::endl;
+      }
+
+      void operator()(const unit_vector_var_decl& x) const {
+        throw pyro_unsupported_error("unit_vector_var_decl");
+      }
+
+      void operator()(const simplex_var_decl& x) const {
+        int n_dims = x.dims_.size();
+        o_<<"init_simplex";
+        if (use_cache_) o_<<"_and_cache";
+        o_<<"(\""<< var_name_ <<"\"";
+        std::string str_dims = get_dims(x.dims_, ctx_);
+        if (str_dims != "") o_<<", dims=("<<str_dims <<")";
+        o_ << ") # real/double";
+        o_<<std::endl;
+      }
+
+      void operator()(const ordered_var_decl& x) const {
+        throw pyro_unsupported_error("ordered_var_decl");
+      }
+
+      void operator()(const positive_ordered_var_decl& x) const {
+        throw pyro_unsupported_error("positive_ordered_var_decl");
+      }
+
+      void operator()(const cholesky_factor_var_decl& x) const {
+        throw pyro_unsupported_error("cholesky_factor_var_decl");
+      }
+
+      void operator()(const cholesky_corr_var_decl& x) const {
+        throw pyro_unsupported_error("cholesky_corr_var_decl");
+      }
+
+      void operator()(const cov_matrix_var_decl& x) const {
+        o_<<"init_matrix";
+        if (use_cache_) o_<<"_and_cache";
+        o_<<"(\""<< var_name_ <<"\", low=0."; //<<function_args(x);
+        o_<<", dims=(";
+        std::string str_dims = get_dims(x.dims_, ctx_);
+        if (str_dims != "") o_<<str_dims<<", ";
+        pyro_generate_expression_as_index(x.K_, NOT_USER_FACING, ctx_, o_);
+        o_<<", ";
+        pyro_generate_expression_as_index(x.K_, NOT_USER_FACING, ctx_, o_);
+
+        o_<<")) # cov-matrix";
+        o_<<std::endl;
+      }
+
+      void operator()(const corr_matrix_var_decl& x) const {
+        throw pyro_unsupported_error("corr_matrix_var_decl");
+      }
+    };
+
+
+    struct pyro_varshape_visgen : public visgen {
+      size_t indent_;
+      std::string var_name_;
+      const pyro_codegen_context& ctx_;
+
+      explicit pyro_varshape_visgen (size_t indent, std::ostream& o, std::string var_name,
+                                     const pyro_codegen_context& ctx)
+        : visgen(o), indent_(indent), var_name_(var_name), ctx_(ctx) {  }
+
+      template <typename D>
+      std::string function_args(const D& x) const {
+        std::stringstream ss;
+        if (has_lub(x)) {
+          ss<<", low=";
+          pyro_generate_expression_as_index(x.range_.low_.expr_, NOT_USER_FACING, ctx_, ss);
+          ss << ", high=";
+          pyro_generate_expression_as_index(x.range_.high_.expr_, NOT_USER_FACING, ctx_, ss);
+        } else if (has_lb(x)) {
+          ss<<", low=";
+          pyro_generate_expression_as_index(x.range_.low_.expr_, NOT_USER_FACING, ctx_, ss);
+        } else if (has_ub(x)) {
+          ss << ", high=";
+          pyro_generate_expression_as_index(x.range_.high_.expr_, NOT_USER_FACING, ctx_, ss);
+        } else {
+          ss<<"";
+        }
+        return ss.str();
+      }
+
+
+
+      void operator()(const double_var_decl& x) const {
+        o_ <<"check_constraints(" <<var_name_<< function_args(x);
+        std::string str_dims = get_dims(x.dims_, ctx_);
+        if (str_dims != "") o_<<", dims=["<<str_dims <<"]";
+        else o_ <<", dims=[1]";
+        o_<<")"<<std::endl;
+      }
+      void operator()(const nil& /*x*/) const { }  // dummy
+
+      void operator()(const int_var_decl& x) const {
+        o_ <<"check_constraints(" <<var_name_<< function_args(x);
+        std::string str_dims = get_dims(x.dims_, ctx_);
+        if (str_dims != "") o_<<", dims=["<<str_dims <<"]";
+        else o_ <<", dims=[1]";
+        o_<<")"<<std::endl;
+      }
+
+      void operator()(const vector_var_decl& x) const {
+        o_ <<"check_constraints(" <<var_name_<< function_args(x);
+        std::string str_dims = get_dims(x.dims_, ctx_);
+        if (str_dims != "") o_<<", dims=["<<str_dims<<",";
+        else o_ <<", dims=[";
+        pyro_generate_expression_as_index(x.M_, NOT_USER_FACING, ctx_, o_);
+        o_<<"])"<<std::endl;;
+      }
+
+      void operator()(const row_vector_var_decl& x) const {
+        throw pyro_unsupported_error("row_vector_var_decl");
+      }
+
+      void operator()(const matrix_var_decl& x) const {
+        o_ <<"check_constraints(" <<var_name_<< function_args(x);
+        std::string str_dims = get_dims(x.dims_, ctx_);
+        if (str_dims != "") o_<<", dims=["<<str_dims<<",";
+        else o_ <<", dims=[";
+        pyro_generate_expression_as_index(x.M_, NOT_USER_FACING, ctx_, o_);
+        o_<<", ";
+        pyro_generate_expression_as_index(x.N_, NOT_USER_FACING, ctx_, o_);
+        o_<<"])"<<std::endl;;
+      }
+
+      void operator()(const unit_vector_var_decl& x) const {
+        throw pyro_unsupported_error("unit_vector_var_decl");
+      }
+
+      void operator()(const simplex_var_decl& x) const {
+        o_ <<"check_constraints(" <<var_name_;
+        std::string str_dims = get_dims(x.dims_, ctx_);
+        if (str_dims != "") o_<<", dims=["<<str_dims <<"]";
+        else o_ <<", dims=[1]";
+        o_<<")"<<std::endl;
+      }
+
+      void operator()(const ordered_var_decl& x) const {
+        throw pyro_unsupported_error("ordered_var_decl");
+      }
+
+      void operator()(const positive_ordered_var_decl& x) const {
+        throw pyro_unsupported_error("positive_ordered_var_decl");
+      }
+
+      void operator()(const cholesky_factor_var_decl& x) const {
+        throw pyro_unsupported_error("cholesky_factor_var_decl");
+      }
+
+      void operator()(const cholesky_corr_var_decl& x) const {
+        throw pyro_unsupported_error("cholesky_corr_var_decl");
+      }
+
+      void operator()(const cov_matrix_var_decl& x) const {
+        o_ <<"check_constraints(" <<var_name_; //<< function_args(x);
+        std::string str_dims = get_dims(x.dims_, ctx_);
+        if (str_dims != "") o_<<", dims=["<<str_dims<<",";
+        else o_ <<", dims=[";
+        pyro_generate_expression_as_index(x.K_, NOT_USER_FACING, ctx_, o_);
+        o_<<", ";
+        pyro_generate_expression_as_index(x.K_, NOT_USER_FACING, ctx_, o_);
+        o_<<"])"<<std::endl;;
+      }
+
+      void operator()(const corr_matrix_var_decl& x) const {
+        throw pyro_unsupported_error("corr_matrix_var_decl");
+      }
+    };
+
+
+    void generate_var_init_python(const var_decl& v, int indent,
+                                  const pyro_codegen_context& ctx, std::ostream& o){
+        std::string var_name = ctx.symbols_.py_name(v.name());
+        generate_indent(indent, o);
+        o << var_name << " = ";
+        stan::lang::pyro_init_visgen  iv(0,o,var_name,false,ctx);
+        boost::apply_visitor(iv, v.decl_);
+    }
+
+
+    void generate_transformed_params_computation(const pyro_ir_program& ir,
+                                                 pyro_ir_printer& pr,
+                                                 pyro_codegen_context& ctx, int indent){
+        std::ostream& o = ctx.o_;
+        generate_indent(1, o);
+        o<<"# INIT transformed parameters\n";
+        pr.statements(ir.transformed_parameters_, indent, o);
+    }
+
+    void extract_data(const pyro_codegen_context& ctx, bool use_derived_data = true) {
+        const program& p = ctx.p_;
+        std::ostream& o = ctx.o_;
+
+        generate_indent(1, o);
+        o<<"# INIT data\n";
+        for (int i = 0; i < p.data_decl_.size(); i++) {
+            generate_indent(1, o);
+            std::string var_name = ctx.symbols_.py_name(p.data_decl_[i].name());
+            o << var_name <<  " = data[\"" << var_name << "\"]\n";
+        }
+
+        int n_td = p.derived_data_decl_.first.size();
+
+        if (n_td > 0 && use_derived_data) {
+            stan::lang::generate_indent(1, o);
+            o<<"# INIT transformed data\n";
+            for(int j=0; j<n_td; j++){
+                if (ctx.dead_.count(p.derived_data_decl_.first[j].name())) continue;
+                std::string var_name = ctx.symbols_.py_name(p.derived_data_decl_.first[j].name());
+                generate_indent(1, o);
+                o << var_name << " = data[\"" << var_name << "\"]\n";
+            }
+        }
+
+        if (!ctx.gather_indexes_.empty() && use_derived_data) {
+            for (std::set<std::string>::const_iterator it = ctx.gather_indexes_.begin();
+                 it != ctx.gather_indexes_.end(); ++it) {
+                std::string var_name = pyro_gather_index_name(ctx.symbols_.py_name(*it));
+                generate_indent(1, o);
+                o << var_name << " = data[\"" << var_name << "\"]\n";
+            }
+        }
+    }
+
+  }
+}
+
+
+
+
+
+
+//TODO: write a visitor struct for statement_ similar to statement_visgen.hpp in /stan/lang/generator/
+void printer(stan::lang::pyro_codegen_context& ctx) {
+    const stan::lang::program& p = ctx.p_;
+    std::ostream& out = ctx.o_;
+
+    out<<"def validate_data_def(data):"<<std::endl;
+    int n_d = p.data_decl_.size();
+    for(int j=0; j<n_d; j++){
+        stan::lang::generate_indent(1, out);
+        std::string var_name = ctx.symbols_.py_name(p.data_decl_[j].name());
+        out<<"assert '"<<var_name<<"' in data, 'variable not found in data: key="<<var_name<<"'"<<std::endl;
+    }
+    stan::lang::extract_data(ctx, false);
+
+    std::stringstream ss_data_def; //to verify data dimensions / constraints in python
+    for(int j=0; j<n_d; j++){
+        std::string var_name = ctx.symbols_.py_name(p.data_decl_[j].name());
+        stan::lang::generate_indent(1, ss_data_def);
+        //ss_data_def << "'"<<var_name<<"' : ";
+        stan::lang::pyro_varshape_visgen  vv(0,ss_data_def, var_name, ctx);
+        boost::apply_visitor(vv, p.data_decl_[j].decl_);
+    }
+    out<<ss_data_def.str();
+
+    stan::lang::pyro_ir_program ir = stan::lang::pyro_lower_program(ctx);
+    stan::lang::pyro_constant_folder(ctx).run(ir);
+    stan::lang::pyro_mixture_enumeration(ctx).run(ir);
+    stan::lang::pyro_loop_vectorizer(ctx).run(ir);
+    stan::lang::pyro_common_subexpressions(ctx).run(ir);
+    stan::lang::pyro_loop_invariant_motion(ctx).run(ir);
+    stan::lang::pyro_zero_based_loops(ctx).run(ir);
+    stan::lang::pyro_dead_code_eliminator(ctx, ctx.options_.keep_).run(ir);
+    stan::lang::pyro_target_accumulation().run(ir);
+    stan::lang::pyro_shape_inference().run(ir);
+    stan::lang::pyro_bounds_analysis(ctx).run(ir);
+    stan::lang::pyro_ir_printer pr;
+
+    int n_td = p.derived_data_decl_.first.size();
+    int n_live_td = 0;
+    for (int j = 0; j < n_td; j++)
+        if (!ctx.dead_.count(p.derived_data_decl_.first[j].name())) ++n_live_td;
+
+    if (n_live_td > 0 || !ctx.gather_indexes_.empty()) {
+
+        out << "\ndef transformed_data(data):" << "\n";
+        stan::lang::extract_data(ctx, false);
+        pr.statements(ir.transformed_data_, 1, out);
+        for(int j=0; j<n_td; j++){
+            if (ctx.dead_.count(p.derived_data_decl_.first[j].name())) continue;
+            std::string var_name = ctx.symbols_.py_name(p.derived_data_decl_.first[j].name());
+            stan::lang::generate_indent(1, out);
+            out << "data[\"" << var_name << "\"] = ";
+            out << var_name << "\n";
+        }
+        // positions of the gathers of vectorized loops, converted once
+        for (std::set<std::string>::const_iterator it = ctx.gather_indexes_.begin();
+             it != ctx.gather_indexes_.end(); ++it) {
+            std::string var_name = ctx.symbols_.py_name(*it);
+            stan::lang::generate_indent(1, out);
+            out << "data[\"" << stan::lang::pyro_gather_index_name(var_name)
+                << "\"] = _gather_index(" << var_name << ")\n";
+        }
+
+    }
+    out << "\ndef init_params(data, params):" << "\n";
+    stan::lang::extract_data(ctx, true);
+
+    stan::lang::generate_indent(1, out);
+    out<<"# assign init values for parameters\n";
+    for (int i = 0; i < p.parameter_decl_.size(); i++) {
+        stan::lang::generate_indent(1, out);
+        std::string var_name = ctx.symbols_.py_name(p.parameter_decl_[i].name());
+        out << "params[\"" << var_name << "\"] = ";
+        stan::lang::pyro_init_visgen  iv(0,out,var_name, false, ctx);
+        boost::apply_visitor(iv, p.parameter_decl_[i].decl_);
+    }
+    out << "\ndef model(data, params):" << "\n";
+    stan::lang::extract_data(ctx, true);
+
+    stan::lang::generate_indent(1, out);
+    out<<"# INIT parameters\n";
+    for (int i = 0; i < p.parameter_decl_.size(); i++) {
+        stan::lang::generate_indent(1, out);
+        out << ctx.symbols_.py_name(p.parameter_decl_[i].name()) <<  " = params[\"";
+        out << ctx.symbols_.py_name(p.parameter_decl_[i].name()) << "\"]\n";
+    }
+    stan::lang::generate_transformed_params_computation(ir, pr, ctx, 1);
+
+    stan::lang::generate_indent(1, out);
+    out<<"# MODEL block"<<std::endl;
+
+    pr.statements(ir.model_, 1, out);
+
+    if (ctx.stats_.enumerated_ > 0) {
+        // the enumerated dimensions go left of the plates
+        out << "\n# discrete latent variables are enumerated in parallel; infer with\n"
+            << "# pyro.infer.TraceEnum_ELBO(max_plate_nesting=max_plate_nesting)\n"
+            << "max_plate_nesting = " << stan::lang::pyro_max_plate_nesting(ir.model_) << "\n";
+    }
+}
+
+namespace stan {
+  namespace lang {
+
+    std::string pyro_build_fingerprint() {
+      return std::string("stan2pyro ") + __DATE__ + " " + __TIME__
+        + " stan " + stan::MAJOR_VERSION + "." + stan::MINOR_VERSION
+        + "." + stan::PATCH_VERSION;
+    }
+
+    std::string json_string(const std::string& s) {
+      std::stringstream ss;
+      ss << '"';
+      for (size_t i = 0; i < s.size(); ++i) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') ss << '\\' << c;
+        else if (c == '\n') ss << "\\n";
+        else if (c == '\t') ss << "\\t";
+        else if (c < 0x20) ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+        else ss << c;
+      }
+      ss << '"';
+      return ss.str();
+    }
+
+    void pyro_compile_result::print_diagnostics(std::ostream& o) const {
+      std::ios_base::fmtflags flags = o.flags();
+      o << std::fixed << std::setprecision(3);
+      o << "{\"ok\": " << (ok_ ? "true" : "false")
+        << ", \"error_kind\": " << json_string(error_kind_)
+        << ", \"messages\": " << json_string(messages_)
+        << ", \"cached\": " << (cache_hit_ ? "true" : "false")
+        << ", \"timings\": {\"read_ms\": " << timings_.read_ms_
+        << ", \"parse_ms\": " << timings_.parse_ms_
+        << ", \"analyze_ms\": " << timings_.analyze_ms_
+        << ", \"emit_ms\": " << timings_.emit_ms_
+        << ", \"total_ms\": " << timings_.total_ms() << "}"
+        << ", \"optimizations\": ";
+      optimizations_.print_json(o);
+      o << "}";
+      o.flags(flags);
+    }
+
+    pyro_compile_result compile_pyro(std::istream& in,
+                                     const pyro_compile_options& options) {
+      pyro_compile_result res;
+      std::stringstream msgs;
+      pyro_compile_cache* cache = options.cache_.get();
+      try {
+        pyro_clock::time_point start = pyro_clock::now();
+        io::program_reader reader(in, options.filename_, options.include_paths_);
+        std::string key;
+        if (cache) {
+          key = pyro_compile_cache::key(reader.program(), options.codegen_key());
+          res.cache_hit_ = cache->lookup(key, res.python_);
+        }
+        res.timings_.read_ms_ = elapsed_ms(start);
+
+        if (!res.cache_hit_) {
+          program p;
+          pyro_parser_guard guard;
+          if (!parse_ast(&msgs, reader, p, "temp_model", res.timings_, guard)) {
+            res.error_kind_ = "syntax";
+            res.messages_ = msgs.str();
+            return res;
+          }
+
+          start = pyro_clock::now();
+          std::stringstream ss;
+          pyro_codegen_context ctx(p, ss, options);
+          res.timings_.analyze_ms_ = elapsed_ms(start);
+
+          start = pyro_clock::now();
+          ::printer(ctx);
+          res.python_ = ss.str();
+          res.timings_.emit_ms_ = elapsed_ms(start);
+          res.optimizations_ = ctx.stats_;
+          for (size_t i = 0; i < ctx.notes_.size(); ++i)
+            msgs << "note: " << ctx.notes_[i] << std::endl;
+          if (cache) cache->store(key, res.python_);
+        }
+        res.ok_ = true;
+      } catch (const pyro_unsupported_error& e) {
+        res.error_kind_ = "unsupported";
+        msgs << e.what() << std::endl;
+      } catch (const std::invalid_argument& e) {
+        // parser and include errors
+        res.error_kind_ = "syntax";
+        msgs << e.what() << std::endl;
+      } catch (const std::exception& e) {
+        res.error_kind_ = "internal";
+        msgs << e.what() << std::endl;
+      }
+      if (!res.ok_) res.python_.clear();
+      res.messages_ = msgs.str();
+      return res;
+    }
+
+  }
+}
+
+struct stan2pyro_options {
+  stan::lang::pyro_compile_options options_;
+  std::string cache_dir_;
+  unsigned long long cache_max_bytes_;
+
+  stan2pyro_options() : cache_max_bytes_(256ULL << 20) { }
+};
+
+struct stan2pyro_result {
+  stan::lang::pyro_compile_result result_;
+  std::string diagnostics_;
+};
+
+/**
+ * @param[in] value decimal digits, with no sign or blanks
+ * @param[out] out the number, set only if value is valid and fits
+ * @return true if value is valid and fits
+ */
+static bool parse_size_option(const char* value, unsigned long long& out) {
+  // strtoull skips blanks and takes a sign, wrapping "-1" around
+  if (!std::isdigit(static_cast<unsigned char>(*value))) return false;
+  char* end;
+  errno = 0;
+  unsigned long long n = std::strtoull(value, &end, 10);
+  if (*end != '\0' || errno == ERANGE) return false;
+  out = n;
+  return true;
+}
+
+extern "C" {
+
+int stan2pyro_abi_version(void) {
+  return STAN2PYRO_ABI_VERSION;
+}
+
+stan2pyro_options* stan2pyro_options_new(void) {
+  return new (std::nothrow) stan2pyro_options();
+}
+
+int stan2pyro_options_set(stan2pyro_options* options, const char* key,
+                          const char* value) {
+  if (!options || !key || !value) return -1;
+  try {
+    std::string k = key;
+    if (k == "filename") {
+      options->options_.filename_ = value;
+    } else if (k == "include_path") {
+      options->options_.include_paths_.push_back(value);
+    } else if (k == "keep") {
+      options->options_.keep_.push_back(value);
+    } else if (k == "subsample") {
+      unsigned long long n;
+      if (!parse_size_option(value, n)) return -1;
+      options->options_.subsample_ = n;
+    } else if (k == "cache_dir" || k == "cache_max_bytes") {
+      // build the new cache first, so that a rejected value leaves the
+      // options as they were
+      std::string dir = options->cache_dir_;
+      unsigned long long max_bytes = options->cache_max_bytes_;
+      if (k == "cache_dir") {
+        dir = value;
+      } else if (!parse_size_option(value, max_bytes)) {
+        return -1;
+      }
+      std::shared_ptr<stan::lang::pyro_compile_cache> cache;
+      if (!dir.empty())
+        cache = std::make_shared<stan::lang::pyro_compile_cache>(dir, max_bytes);
+      options->cache_dir_ = dir;
+      options->cache_max_bytes_ = max_bytes;
+      options->options_.cache_ = cache;
+    } else {
+      return -1;
+    }
+  } catch (const std::exception& e) {
+    return -1;
+  }
+  return 0;
+}
+
+void stan2pyro_options_free(stan2pyro_options* options) {
+  delete options;
+}
+
+stan2pyro_result* stan2pyro_compile(const char* stan_source,
+                                    const stan2pyro_options* options) {
+  try {
+    std::unique_ptr<stan2pyro_result> res(new stan2pyro_result());
+    std::stringstream in(stan_source ? stan_source : "");
+    res->result_ = stan::lang::compile_pyro(in, options ? options->options_
+                                            : stan::lang::pyro_compile_options());
+    std::stringstream ss;
+    res->result_.print_diagnostics(ss);
+    res->diagnostics_ = ss.str();
+    return res.release();
+  } catch (const std::exception& e) {
+    return 0;
+  }
+}
+
+int stan2pyro_result_ok(const stan2pyro_result* result) {
+  return result && result->result_.ok_ ? 1 : 0;
+}
+
+const char* stan2pyro_result_python(const stan2pyro_result* result) {
+  return result ? result->result_.python_.c_str() : "";
+}
+
+const char* stan2pyro_result_diagnostics(const stan2pyro_result* result) {
+  return result ? result->diagnostics_.c_str() : "";
+}
+
+void stan2pyro_result_free(stan2pyro_result* result) {
+  delete result;
+}
+
+}
@@ -0,0 +1,214 @@
+#ifndef STAN2PYRO_PYRO_COMPILE_CACHE_HPP
+#define STAN2PYRO_PYRO_COMPILE_CACHE_HPP
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace stan {
+  namespace lang {
+
+    /**
+     * 64-bit FNV-1a hash, chained through h.
+     *
+     * @param[in] s bytes to hash
+     * @param[in] h hash of the preceding bytes
+     * @return hash of the preceding bytes followed by s
+     */
+    inline std::uint64_t fnv1a_64(const std::string& s,
+                                  std::uint64_t h = 14695981039346656037ULL) {
+      for (size_t i = 0; i < s.size(); ++i) {
+        h ^= static_cast<unsigned char>(s[i]);
+        h *= 1099511628211ULL;
+      }
+      return h;
+    }
+
+    /**
+     * Identifies the compiler that produced a cached module.  Defined in
+     * libstan2pyro.cpp, whose build time changes whenever any code
+     * generator header changes, so rebuilding stan2pyro invalidates the
+     * cache.
+     *
+     * @return build fingerprint
+     */
+    std::string pyro_build_fingerprint();
+
+    /**
+     * On-disk cache of generated Python modules, keyed by a hash of the
+     * include-expanded Stan program, the compiler build fingerprint and
+     * the options that affect code generation.  Each entry is one
+     * <key>.py file in the cache directory.
+     *
+     * Entries are written to a temporary file and renamed into place,
+     * so readers in other threads or processes never see partial
+     * modules.  A hit refreshes the entry's modification time; when the
+     * directory exceeds its size cap the least recently used entries are
+     * deleted.  All methods are thread-safe.
+     */
+    class pyro_compile_cache {
+      std::string dir_;
+      std::uint64_t max_bytes_;
+      std::mutex mutex_;  // guards everything below
+      std::uint64_t bytes_;
+      size_t hits_;
+      size_t misses_;
+      size_t stores_;
+      size_t evictions_;
+
+      std::string path(const std::string& key) const {
+        return dir_ + "/" + key + ".py";
+      }
+
+      /**
+       * Scan the directory, returning its entries as (mtime, path)
+       * pairs and setting bytes_ to their total size.
+       */
+      std::vector<std::pair<time_t, std::string> > scan() {
+        std::vector<std::pair<time_t, std::string> > entries;
+        bytes_ = 0;
+        DIR* d = opendir(dir_.c_str());
+        if (!d) return entries;
+        for (struct dirent* e = readdir(d); e; e = readdir(d)) {
+          std::string name = e->d_name;
+          if (name.size() < 3 || name.compare(name.size() - 3, 3, ".py") != 0)
+            continue;
+          std::string p = dir_ + "/" + name;
+          struct stat st;
+          if (stat(p.c_str(), &st) != 0) continue;
+          bytes_ += st.st_size;
+          entries.push_back(std::make_pair(st.st_mtime, p));
+        }
+        closedir(d);
+        return entries;
+      }
+
+      /**
+       * Delete least recently used entries until the directory fits
+       * the size cap.  Requires mutex_.
+       */
+      void evict() {
+        std::vector<std::pair<time_t, std::string> > entries = scan();
+        std::sort(entries.begin(), entries.end());
+        for (size_t i = 0; i < entries.size() && bytes_ > max_bytes_; ++i) {
+          struct stat st;
+          if (stat(entries[i].second.c_str(), &st) != 0) continue;
+          if (std::remove(entries[i].second.c_str()) != 0) continue;
+          bytes_ -= std::min<std::uint64_t>(bytes_, st.st_size);
+          ++evictions_;
+        }
+      }
+
+    public:
+      /**
+       * Open (and create if needed) the cache directory.  Its parent
+       * must exist.
+       *
+       * @param[in] dir cache directory
+       * @param[in] max_bytes size cap of the directory's entries
+       * @throw std::invalid_argument if the directory cannot be created
+       */
+      pyro_compile_cache(const std::string& dir, std::uint64_t max_bytes)
+        : dir_(dir), max_bytes_(max_bytes), bytes_(0),
+          hits_(0), misses_(0), stores_(0), evictions_(0) {
+        if (mkdir(dir_.c_str(), 0755) != 0 && errno != EEXIST)
+          throw std::invalid_argument("cannot create cache directory: " + dir_);
+        scan();
+      }
+
+      /**
+       * @param[in] program include-expanded Stan program
+       * @param[in] options options that change the generated code
+       * @return cache key of the program, as 16 hex digits
+       */
+      static std::string key(const std::string& program,
+                             const std::string& options) {
+        std::uint64_t h = fnv1a_64(program);
+        h = fnv1a_64(std::string(1, '\0') + pyro_build_fingerprint(), h);
+        h = fnv1a_64(std::string(1, '\0') + options, h);
+        std::stringstream ss;
+        ss << std::hex;
+        ss.width(16);
+        ss.fill('0');
+        ss << h;
+        return ss.str();
+      }
+
+      /**
+       * @param[in] key cache key
+       * @param[out] code cached module, if found
+       * @return true on a hit
+       */
+      bool lookup(const std::string& key, std::string& code) {
+        std::ifstream fin(path(key).c_str());
+        bool hit = static_cast<bool>(fin);
+        if (hit) {
+          std::stringstream ss;
+          ss << fin.rdbuf();
+          code = ss.str();
+          utime(path(key).c_str(), 0);
+        }
+        std::lock_guard<std::mutex> l(mutex_);
+        if (hit) ++hits_;
+        else ++misses_;
+        return hit;
+      }
+
+      /**
+       * Store a module under the key, evicting old entries if the cache
+       * grows past its cap.  Failures to write are ignored: the cache is
+       * only an optimization.
+       *
+       * @param[in] key cache key
+       * @param[in] code generated module
+       */
+      void store(const std::string& key, const std::string& code) {
+        static std::atomic<unsigned> counter(0);
+        std::stringstream tmp;
+        tmp << path(key) << ".tmp." << getpid() << "." << counter++;
+        {
+          std::ofstream fout(tmp.str().c_str());
+          fout << code;
+          fout.close();
+          if (!fout || std::rename(tmp.str().c_str(), path(key).c_str()) != 0) {
+            std::remove(tmp.str().c_str());
+            return;
+          }
+        }
+        std::lock_guard<std::mutex> l(mutex_);
+        ++stores_;
+        bytes_ += code.size();
+        if (bytes_ > max_bytes_) evict();
+      }
+
+      /**
+       * Write hit, miss, store and eviction counts as a JSON object.
+       *
+       * @param[in,out] o stream for the statistics
+       */
+      void print_stats(std::ostream& o) {
+        std::lock_guard<std::mutex> l(mutex_);
+        o << "{\"hits\": " << hits_ << ", \"misses\": " << misses_
+          << ", \"stores\": " << stores_ << ", \"evictions\": " << evictions_
+          << ", \"bytes\": " << bytes_ << "}";
+      }
+    };
+
+  }
+}
+#endif
@@ -0,0 +1,203 @@
+#ifndef STAN2PYRO_PYRO_COMPILER_HPP
+#define STAN2PYRO_PYRO_COMPILER_HPP
+
+#include <pyro_compile_cache.hpp>
+#include <boost/lexical_cast.hpp>
+#include <chrono>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace stan {
+  namespace lang {
+
+    typedef std::chrono::steady_clock pyro_clock;
+
+    inline double elapsed_ms(const pyro_clock::time_point& start) {
+      return std::chrono::duration<double, std::milli>(pyro_clock::now() - start).count();
+    }
+
+    /**
+     * Wall-clock time of each compilation phase, in milliseconds.
+     * Stan type checks in the grammar's semantic actions, so parsing
+     * and type checking are a single phase.
+     */
+    struct pyro_phase_timings {
+      double read_ms_;      // include expansion by io::program_reader
+      double parse_ms_;     // parse and type check
+      double analyze_ms_;   // symbol table and codegen context
+      double emit_ms_;      // Python generation
+
+      pyro_phase_timings()
+        : read_ms_(0), parse_ms_(0), analyze_ms_(0), emit_ms_(0) { }
+
+      double total_ms() const {
+        return read_ms_ + parse_ms_ + analyze_ms_ + emit_ms_;
+      }
+
+      void print(std::ostream& o) const {
+        o << "# phase timings (ms)" << std::endl;
+        o << "read            " << read_ms_ << std::endl;
+        o << "parse+typecheck " << parse_ms_ << std::endl;
+        o << "analyze         " << analyze_ms_ << std::endl;
+        o << "emit            " << emit_ms_ << std::endl;
+        o << "total           " << total_ms() << std::endl;
+      }
+    };
+
+    /**
+     * What the optimization passes did to one program.
+     */
+    struct pyro_optimization_stats {
+      size_t folded_;       // expressions replaced by their constant value
+      size_t propagated_;   // reads of constant variables replaced by the constant
+      size_t hoisted_;      // expressions and declarations moved out of loops
+      size_t shared_;       // repeated expressions bound to one temporary
+      size_t eliminated_;   // dead statements and declarations dropped
+      size_t rebased_;      // for loops run over 0-based indexes
+      size_t accesses_;     // accesses with single indexes
+      size_t in_bounds_;    // those proven within bounds, left unchecked
+      size_t enumerated_;   // mixtures turned into enumerated latent variables
+      size_t subsampled_;   // plates of observations drawn as mini-batches
+      size_t reduced_;      // accumulation loops turned into one reduction
+
+      pyro_optimization_stats()
+        : folded_(0), propagated_(0), hoisted_(0), shared_(0), eliminated_(0),
+          rebased_(0), accesses_(0), in_bounds_(0), enumerated_(0),
+          subsampled_(0), reduced_(0) { }
+
+      /**
+       * Write the counts as one JSON object.
+       *
+       * @param[in,out] o stream for the counts
+       */
+      void print_json(std::ostream& o) const {
+        o << "{\"folded\": " << folded_
+          << ", \"propagated\": " << propagated_
+          << ", \"hoisted\": " << hoisted_
+          << ", \"shared\": " << shared_
+          << ", \"eliminated\": " << eliminated_
+          << ", \"rebased\": " << rebased_
+          << ", \"accesses\": " << accesses_
+          << ", \"in_bounds\": " << in_bounds_
+          << ", \"enumerated\": " << enumerated_
+          << ", \"subsampled\": " << subsampled_
+          << ", \"reduced\": " << reduced_ << "}";
+      }
+    };
+
+    /**
+     * Options of one compilation.
+     */
+    struct pyro_compile_options {
+      /**
+       * Name of the program in messages, and base of relative includes.
+       */
+      std::string filename_;
+
+      /**
+       * Directories searched by #include.
+       */
+      std::vector<std::string> include_paths_;
+
+      /**
+       * Compile cache, or null to always compile.  Shared by every copy
+       * of the options.
+       */
+      std::shared_ptr<pyro_compile_cache> cache_;
+
+      /**
+       * Transformed data, transformed parameters and model locals to
+       * compute even if no sampling statement needs them.
+       */
+      std::vector<std::string> keep_;
+
+      /**
+       * Mini-batch size of the plates of observations over the rows of
+       * the data, or 0 to observe every row (see pyro_loop_vectorizer).
+       */
+      size_t subsample_;
+
+      pyro_compile_options() : filename_("unknown file name"), subsample_(0) { }
+
+      /**
+       * Options that change the generated code; part of the cache key.
+       *
+       * @return canonical spelling of those options
+       */
+      std::string codegen_key() const {
+        std::set<std::string> keep(keep_.begin(), keep_.end());
+        std::string key;
+        for (std::set<std::string>::const_iterator it = keep.begin(); it != keep.end(); ++it)
+          key += (key.empty() ? "keep=" : ",") + *it;
+        if (subsample_ > 0)
+          key += (key.empty() ? "" : ";") + std::string("subsample=")
+            + boost::lexical_cast<std::string>(subsample_);
+        return key;
+      }
+    };
+
+    /**
+     * Outcome of one compilation.
+     */
+    struct pyro_compile_result {
+      bool ok_;
+      bool cache_hit_;
+
+      /**
+       * Class of the failure: "io", "syntax" (parse or type check),
+       * "unsupported" (no Pyro translation) or "internal"; empty on
+       * success.
+       */
+      std::string error_kind_;
+
+      /**
+       * Generated Python module; empty on failure.
+       */
+      std::string python_;
+
+      /**
+       * Parser warnings and, on failure, the error message.
+       */
+      std::string messages_;
+
+      pyro_phase_timings timings_;
+
+      /**
+       * Optimization counts; all zero when served from the cache.
+       */
+      pyro_optimization_stats optimizations_;
+
+      pyro_compile_result() : ok_(false), cache_hit_(false) { }
+
+      /**
+       * Write everything but the module as one JSON object.
+       *
+       * @param[in,out] o stream for the diagnostics
+       */
+      void print_diagnostics(std::ostream& o) const;
+    };
+
+    /**
+     * Compile a Stan program to a Python module.  Errors are reported
+     * in the result, never thrown.  Safe to call from several threads.
+     *
+     * @param[in] in Stan program
+     * @param[in] options compile options
+     * @return generated module and diagnostics
+     */
+    pyro_compile_result compile_pyro(std::istream& in,
+                                     const pyro_compile_options& options);
+
+    /**
+     * @param[in] s any string
+     * @return s as a quoted, escaped JSON string
+     */
+    std::string json_string(const std::string& s);
+
+  }
+}
+#endif
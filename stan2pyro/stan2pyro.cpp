@@ -1,564 +1,286 @@
-#include <stan/version.hpp>
-#include <stan/lang/compiler.hpp>
-#include <stan/lang/ast.hpp>
-#include <gen_pyro_statement.hpp>
-#include <gen_pyro_expression.hpp>
-#include <stan/lang/ast/node/expression.hpp>
-#include <stan/lang/generator/generate_indent.hpp>
-#include <stan/lang/ast/node/var_decl.hpp>
-#include <stan/lang/ast/node/vector_var_decl.hpp>
-#include <stan/lang/generator/has_lb.hpp>
-#include <stan/lang/generator/has_lub.hpp>
-#include <stan/lang/generator/has_ub.hpp>
-
-#include <boost/variant/apply_visitor.hpp>
-#include <ostream>
-
-#include <utility>
-#include <vector>
+#include <pyro_compiler.hpp>
+#include <pyro_compile_cache.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <exception>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
-#include <stdexcept>
+#include <memory>
+#include <sstream>
 #include <string>
-#include <cstring>
-
-namespace stan {
-  namespace lang {
+#include <thread>
+#include <vector>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+
+/**
+ * Compile one Stan file.  A file that cannot be opened is reported as
+ * an "io" error.
+ *
+ * @param[in] model_fname Stan file
+ * @param[in] options compile options; the filename is set from model_fname
+ * @return generated module and diagnostics
+ */
+stan::lang::pyro_compile_result compile_stan_file(const std::string& model_fname,
+                                                  stan::lang::pyro_compile_options options) {
+    std::ifstream fin(model_fname.c_str());
+    if (!fin) {
+        stan::lang::pyro_compile_result res;
+        res.error_kind_ = "io";
+        res.messages_ = "cannot open Stan file: " + model_fname + "\n";
+        return res;
+    }
+    options.filename_ = model_fname;
+    return stan::lang::compile_pyro(fin, options);
+}
 
-    bool compile_ast(std::ostream* msgs, std::istream& in, std::ostream& out, program& prog,
-                 const std::string& name, const bool allow_undefined = false,
-                 const std::string& filename = "unknown file name",
-                 const std::vector<std::string>& include_paths
-                  = std::vector<std::string>()) {
-      io::program_reader reader(in, filename, include_paths);
-      std::string s = reader.program();
-      std::stringstream ss(s);
-      //program prog;
-      bool parse_succeeded = parse(msgs, ss, name, reader, prog,
-                                   allow_undefined);
-      if (!parse_succeeded)
+/**
+ * One entry of a batch manifest and its outcome.
+ */
+struct batch_job {
+    std::string input_;
+    std::string output_;
+    stan::lang::pyro_compile_result result_;
+
+    batch_job(const std::string& input, const std::string& output)
+      : input_(input), output_(output) { }
+};
+
+/**
+ * Read a batch manifest: one "input.stan output.py" pair per line,
+ * separated by whitespace.  Blank lines and lines starting with # are
+ * skipped.
+ *
+ * @param[in] fname manifest file
+ * @param[out] jobs one job per pair
+ * @param[in,out] err stream for errors
+ * @return true if the manifest was read
+ */
+bool read_manifest(const std::string& fname, std::vector<batch_job>& jobs,
+                   std::ostream& err) {
+    std::ifstream fin(fname.c_str());
+    if (!fin) {
+        err << "cannot open manifest: " << fname << std::endl;
         return false;
-      generate_cpp(prog, name, reader.history(), out);
-      return true;
     }
-
-    template <bool isLHS>
-    void generate_pyro_indexed_expr(const std::string& expr,
-                               const std::vector<expression>& indexes,
-                               base_expr_type base_type, size_t e_num_dims,
-                               bool user_facing, std::ostream& o) {
-      if (user_facing) {
-        generate_indexed_expr_user(expr, indexes, o);
-        return;
-      }
-      size_t ai_size = indexes.size();
-      if (ai_size == 0) {
-        o << expr;
-        return;
-      }
-      //if (ai_size <= (e_num_dims + 1) || !base_type.is_matrix_type()) {
-
-        std::string curr_str = expr;
-        if (isLHS) o << expr;
-
-        for (size_t n = 0; n < ai_size; ++n) {
-          //o << '[';
-          std::stringstream expr_ix;
-          pyro_generate_expression_as_index(indexes[n], user_facing, expr_ix);
-          if (! isLHS){
-              curr_str = "_index_select(" + curr_str + ", " + expr_ix.str() + " - 1) ";
-          }
-          else{
-            o << "[" << expr_ix.str() << " - 1]";
-          }
-          //o << " - 1]";
+    std::string line;
+    for (int n = 1; std::getline(fin, line); ++n) {
+        std::istringstream ss(line);
+        std::string input, output, rest;
+        if (!(ss >> input) || input[0] == '#')
+            continue;
+        if (!(ss >> output) || (ss >> rest)) {
+            err << fname << ":" << n << ": expected <input.stan> <output.py>" << std::endl;
+            return false;
         }
-        if (!isLHS) o << curr_str;
-      //}
-      /*else {
-        //std::cout<<"generate_pyro_indexed_expr cannot be computed in this case ai_size="<<ai_size;
-        //std::cout<<" e_num_dims="<<e_num_dims << "\n";
-        //assert(false); //"generate_pyro_indexed_expr cannot be computed in this case");
-        for (size_t n = 0; n < ai_size - 1; ++n)
-          o << (isLHS ? "get_base1_lhs(" : "get_base1(");
-        o << expr;
-        for (size_t n = 0; n < ai_size - 2; ++n) {
-          o << ',';
-          pyro_generate_expression_as_index(indexes[n], user_facing, o);
-          o << ',';
-          generate_quoted_string(expr, o);
-          o << ',' << (n+1) << ')';
-        }
-        o << ',';
-        pyro_generate_expression_as_index(indexes[ai_size - 2U], user_facing, o);
-        o << ',';
-        pyro_generate_expression_as_index(indexes[ai_size - 1U], user_facing, o);
-        o << ',';
-        generate_quoted_string(expr, o);
-        o << ',' << (ai_size - 1U) << ')';
-      }*/
+        jobs.push_back(batch_job(input, output));
     }
+    return true;
+}
 
-    std::string safeguard_varname(std::string name){
-        std::string tmp[] = {"False", "class", "finally", "is", "return", "None", "continue", "for",
-        "lambda", "try", "True", "def", "from", "nonlocal", "while", "and", "del", "global", "not", "with", "as",
-        "elif", "if", "or", "yield", "assert", "else", "import", "pass", "break", "except", "in", "raise"};
-        std::set<std::string> res_keys(tmp, tmp + sizeof(tmp) / sizeof(tmp[0]));
-        if (res_keys.find(name) != res_keys.end()) return name + "_";
-        else return name;
+void run_batch_job(batch_job& job, const stan::lang::pyro_compile_options& options) {
+    job.result_ = compile_stan_file(job.input_, options);
+    if (!job.result_.ok_) return;
+    std::ofstream fout(job.output_.c_str());
+    fout << job.result_.python_;
+    fout.close();
+    if (!fout) {
+        job.result_.ok_ = false;
+        job.result_.error_kind_ = "io";
+        job.result_.messages_ += "cannot write Python file: " + job.output_ + "\n";
     }
+    job.result_.python_.clear();
+}
 
-    std::string get_dims(const std::vector<expression>& dims)  {
-        std::stringstream ss;
-        //ss<<"(";
-        int n_dims = dims.size();
-        if (n_dims==0){
-            return "";
-        }
-        for (int i=0;i<n_dims;i++){
-            pyro_generate_expression_as_index(dims[i], NOT_USER_FACING, ss);
-            if (i !=n_dims-1)
-                ss<< ", ";
-        }
-        //ss<<")";
-        return ss.str();
-        //return ", dims=(" +ss.str() + ")";
+/**
+ * Compile every job on a fixed pool of worker threads.  Workers take
+ * the next unclaimed job until none are left, so slow models do not
+ * hold back the rest of the batch.
+ *
+ * @param[in,out] jobs jobs to run; outcomes are stored in place
+ * @param[in] n_threads number of workers
+ * @param[in] options compile options shared by the workers
+ */
+void run_batch(std::vector<batch_job>& jobs, size_t n_threads,
+               const stan::lang::pyro_compile_options& options) {
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < std::min(n_threads, jobs.size()); ++t) {
+        workers.push_back(std::thread([&jobs, &next, &options]() {
+            for (size_t i = next++; i < jobs.size(); i = next++)
+                run_batch_job(jobs[i], options);
+        }));
     }
+    for (size_t t = 0; t < workers.size(); ++t)
+        workers[t].join();
+}
 
-    struct pyro_init_visgen : public visgen {
-      size_t indent_;
-      std::string var_name_;
-      bool use_cache_;
-      explicit pyro_init_visgen (size_t indent, std::ostream& o, std::string var_name, bool use_cache)
-        : visgen(o), indent_(indent), var_name_(var_name), use_cache_(use_cache) {  }
-
-      template <typename D>
-      std::string function_args(const D& x) const {
-        std::stringstream ss;
-        if (has_lub(x)) {
-          ss<<", low=";
-          pyro_generate_expression_as_index(x.range_.low_.expr_, NOT_USER_FACING, ss);
-          ss << ", high=";
-          pyro_generate_expression_as_index(x.range_.high_.expr_, NOT_USER_FACING, ss);
-        } else if (has_lb(x)) {
-          ss<<", low=";
-          pyro_generate_expression_as_index(x.range_.low_.expr_, NOT_USER_FACING, ss);
-        } else if (has_ub(x)) {
-          ss << ", high=";
-          pyro_generate_expression_as_index(x.range_.high_.expr_, NOT_USER_FACING, ss);
-        } else {
-          ss<<"";
-        }
-        return ss.str();
-      }
-
-
-
-      void operator()(const double_var_decl& x) const {
-        int n_dims = x.dims_.size();
-        o_<<"init_real";
-        if (use_cache_) o_<<"_and_cache";
-        o_<<"(\""<< var_name_ <<"\""<<function_args(x);
-        std::string str_dims = get_dims(x.dims_);
-        if (str_dims != "") o_<<", dims=("<<str_dims <<")";
-        o_ << ") # real/double";
-        o_<<std::endl;
-      }
-      void operator()(const nil& /*x*/) const { }  // dummy
-
-      void operator()(const int_var_decl& x) const {
-        int n_dims = x.dims_.size();
-        o_<<"init_int";
-        if (use_cache_) o_<<"_and_cache";
-        o_<<"(\""<< var_name_ <<"\""<<function_args(x);
-        std::string str_dims = get_dims(x.dims_);
-        if (str_dims != "") o_<<", dims=("<<str_dims <<")";
-        o_ << ") # real/double";
-        o_<<std::endl;
-      }
-
-      void operator()(const vector_var_decl& x) const {
-        o_<<"init_vector";
-        if (use_cache_) o_<<"_and_cache";
-        o_<<"(\""<< var_name_ <<"\""<<function_args(x)<<", dims=(";
-        std::string str_dims = get_dims(x.dims_);
-        if (str_dims != "") o_<<str_dims<<", ";
-        pyro_generate_expression_as_index(x.M_, NOT_USER_FACING, o_);
-        o_<<")) # vector";
-        o_<<std::endl;
-      }
-
-      void operator()(const row_vector_var_decl& x) const {
-        assert (false);
-      }
-
-      void operator()(const matrix_var_decl& x) const {
-        o_<<"init_matrix";
-        if (use_cache_) o_<<"_and_cache";
-        o_<<"(\""<< var_name_ <<"\""<<function_args(x)<<", dims=(";
-        std::string str_dims = get_dims(x.dims_);
-        if (str_dims != "") o_<<str_dims<<", ";
-        pyro_generate_expression_as_index(x.M_, NOT_USER_FACING, o_);
-        o_<<", ";
-        pyro_generate_expression_as_index(x.N_, NOT_USER_FACING, o_);
-
-        o_<<")) # matrix";
-        o_<<std::endl;
-      }
-
-      void operator()(const unit_vector_var_decl& x) const {
-        assert (false);
-      }
-
-      void operator()(const simplex_var_decl& x) const {
-        int n_dims = x.dims_.size();
-        o_<<"init_simplex";
-        if (use_cache_) o_<<"_and_cache";
-        o_<<"(\""<< var_name_ <<"\"";
-        std::string str_dims = get_dims(x.dims_);
-        if (str_dims != "") o_<<", dims=("<<str_dims <<")";
-        o_ << ") # real/double";
-        o_<<std::endl;
-      }
-
-      void operator()(const ordered_var_decl& x) const {
-        assert (false);
-      }
-
-      void operator()(const positive_ordered_var_decl& x) const {
-        assert (false);
-      }
-
-      void operator()(const cholesky_factor_var_decl& x) const {
-        assert (false);
-      }
-
-      void operator()(const cholesky_corr_var_decl& x) const {
-        assert (false);
-      }
-
-      void operator()(const cov_matrix_var_decl& x) const {
-        o_<<"init_matrix";
-        if (use_cache_) o_<<"_and_cache";
-        o_<<"(\""<< var_name_ <<"\", low=0."; //<<function_args(x);
-        o_<<", dims=(";
-        std::string str_dims = get_dims(x.dims_);
-        if (str_dims != "") o_<<str_dims<<", ";
-        pyro_generate_expression_as_index(x.K_, NOT_USER_FACING, o_);
-        o_<<", ";
-        pyro_generate_expression_as_index(x.K_, NOT_USER_FACING, o_);
-
-        o_<<")) # cov-matrix";
-        o_<<std::endl;
-      }
-
-      void operator()(const corr_matrix_var_decl& x) const {
-        assert (false);
-      }
-    };
-
+/**
+ * Write the outcome of a batch as JSON: totals, then per file its
+ * status ("ok" or "error"), parser/codegen messages, phase timings,
+ * optimization counts and whether it was served from the cache.
+ */
+void print_batch_summary(const std::vector<batch_job>& jobs, size_t n_threads,
+                         double wall_ms, stan::lang::pyro_compile_cache* cache,
+                         std::ostream& o) {
+    size_t n_ok = 0;
+    for (size_t i = 0; i < jobs.size(); ++i)
+        if (jobs[i].result_.ok_) ++n_ok;
+    o << std::fixed << std::setprecision(3);
+    o << "{" << std::endl;
+    o << "  \"threads\": " << n_threads << "," << std::endl;
+    o << "  \"wall_ms\": " << wall_ms << "," << std::endl;
+    o << "  \"succeeded\": " << n_ok << "," << std::endl;
+    o << "  \"failed\": " << (jobs.size() - n_ok) << "," << std::endl;
+    if (cache) {
+        o << "  \"cache\": ";
+        cache->print_stats(o);
+        o << "," << std::endl;
+    }
+    o << "  \"files\": [";
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const batch_job& job = jobs[i];
+        const stan::lang::pyro_compile_result& res = job.result_;
+        o << (i == 0 ? "" : ",") << std::endl;
+        o << "    {\"input\": " << stan::lang::json_string(job.input_)
+          << ", \"output\": " << stan::lang::json_string(job.output_)
+          << ", \"status\": \"" << (res.ok_ ? "ok" : "error") << "\""
+          << ", \"error_kind\": " << stan::lang::json_string(res.error_kind_)
+          << ", \"cached\": " << (res.cache_hit_ ? "true" : "false")
+          << ", \"message\": " << stan::lang::json_string(res.messages_)
+          << ", \"read_ms\": " << res.timings_.read_ms_
+          << ", \"parse_ms\": " << res.timings_.parse_ms_
+          << ", \"analyze_ms\": " << res.timings_.analyze_ms_
+          << ", \"emit_ms\": " << res.timings_.emit_ms_
+          << ", \"total_ms\": " << res.timings_.total_ms()
+          << ", \"optimizations\": ";
+        res.optimizations_.print_json(o);
+        o << "}";
+    }
+    o << std::endl << "  ]" << std::endl << "}" << std::endl;
+}
 
-    struct pyro_varshape_visgen : public visgen {
-      size_t indent_;
-      std::string var_name_;
+/**
+ * Parse a non-negative decimal size argument.
+ *
+ * @param[in] arg command line argument
+ * @param[out] out parsed value; unchanged unless arg is valid
+ * @return true if arg is a whole non-negative number that fits
+ */
+bool parse_size_arg(const char* arg, unsigned long long& out) {
+    // strtoull skips blanks and takes a sign, wrapping "-1" around
+    if (!std::isdigit(static_cast<unsigned char>(*arg))) return false;
+    char* end;
+    errno = 0;
+    unsigned long long n = std::strtoull(arg, &end, 10);
+    if (*end != '\0' || errno == ERANGE) return false;
+    out = n;
+    return true;
+}
 
-      explicit pyro_varshape_visgen (size_t indent, std::ostream& o, std::string var_name)
-        : visgen(o), indent_(indent), var_name_(var_name){  }
+void print_usage(std::ostream& o) {
+    o << "usage: stan2pyro [--phase-timings] [--keep <var>]... [--subsample B] [cache options] <stan_file>" << std::endl;
+    o << "       stan2pyro --batch <manifest> [--jobs N] [--summary <json_file>] [--keep <var>]... [--subsample B] [cache options]" << std::endl;
+    o << "  --phase-timings  report the time spent in each compilation phase on stderr" << std::endl;
+    o << "  --batch          compile every \"input.stan output.py\" line of the manifest" << std::endl;
+    o << "  --jobs           number of worker threads (default: number of cores)" << std::endl;
+    o << "  --summary        write the JSON batch summary to this file instead of stdout" << std::endl;
+    o << "  --keep           compute this transformed data, transformed parameter or local even if" << std::endl;
+    o << "                   no sampling statement needs it; may be repeated" << std::endl;
+    o << "  --subsample      observe the rows of the data in random mini-batches of B, with the" << std::endl;
+    o << "                   likelihood scaled to an unbiased estimate (for SVI)" << std::endl;
+    o << "  --cache-dir      reuse Python modules cached in this directory for unchanged programs" << std::endl;
+    o << "  --cache-max-bytes  evict least recently used modules beyond this size (default: 256MB)" << std::endl;
+}
 
-      template <typename D>
-      std::string function_args(const D& x) const {
-        std::stringstream ss;
-        if (has_lub(x)) {
-          ss<<", low=";
-          pyro_generate_expression_as_index(x.range_.low_.expr_, NOT_USER_FACING, ss);
-          ss << ", high=";
-          pyro_generate_expression_as_index(x.range_.high_.expr_, NOT_USER_FACING, ss);
-        } else if (has_lb(x)) {
-          ss<<", low=";
-          pyro_generate_expression_as_index(x.range_.low_.expr_, NOT_USER_FACING, ss);
-        } else if (has_ub(x)) {
-          ss << ", high=";
-          pyro_generate_expression_as_index(x.range_.high_.expr_, NOT_USER_FACING, ss);
+int main(int argc, char *argv[]) {
+    bool phase_timings = false;
+    std::string  model_fname, manifest_fname, summary_fname, cache_dir;
+    size_t n_threads = std::thread::hardware_concurrency();
+    unsigned long long cache_max_bytes = 256ULL << 20;
+    std::vector<std::string> keep;
+    size_t subsample = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--phase-timings") {
+            phase_timings = true;
+        } else if (arg == "--batch" && i + 1 < argc) {
+            manifest_fname = argv[++i];
+        } else if (arg == "--summary" && i + 1 < argc) {
+            summary_fname = argv[++i];
+        } else if (arg == "--jobs" && i + 1 < argc && std::atoi(argv[i + 1]) > 0) {
+            n_threads = std::atoi(argv[++i]);
+        } else if (arg == "--keep" && i + 1 < argc) {
+            keep.push_back(argv[++i]);
+        } else if (arg == "--subsample" && i + 1 < argc && std::atoi(argv[i + 1]) > 0) {
+            subsample = std::atoi(argv[++i]);
+        } else if (arg == "--cache-dir" && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (arg == "--cache-max-bytes" && i + 1 < argc
+                   && parse_size_arg(argv[i + 1], cache_max_bytes)) {
+            ++i;
+        } else if (arg.compare(0, 2, "--") != 0 && model_fname.empty()) {
+            model_fname = arg;
         } else {
-          ss<<"";
-        }
-        return ss.str();
-      }
-
-
-
-      void operator()(const double_var_decl& x) const {
-        o_ <<"check_constraints(" <<var_name_<< function_args(x);
-        std::string str_dims = get_dims(x.dims_);
-        if (str_dims != "") o_<<", dims=["<<str_dims <<"]";
-        else o_ <<", dims=[1]";
-        o_<<")"<<std::endl;
-      }
-      void operator()(const nil& /*x*/) const { }  // dummy
-
-      void operator()(const int_var_decl& x) const {
-        o_ <<"check_constraints(" <<var_name_<< function_args(x);
-        std::string str_dims = get_dims(x.dims_);
-        if (str_dims != "") o_<<", dims=["<<str_dims <<"]";
-        else o_ <<", dims=[1]";
-        o_<<")"<<std::endl;
-      }
-
-      void operator()(const vector_var_decl& x) const {
-        o_ <<"check_constraints(" <<var_name_<< function_args(x);
-        std::string str_dims = get_dims(x.dims_);
-        if (str_dims != "") o_<<", dims=["<<str_dims<<",";
-        else o_ <<", dims=[";
-        pyro_generate_expression_as_index(x.M_, NOT_USER_FACING, o_);
-        o_<<"])"<<std::endl;;
-      }
-
-      void operator()(const row_vector_var_decl& x) const {
-        assert (false);
-      }
-
-      void operator()(const matrix_var_decl& x) const {
-        o_ <<"check_constraints(" <<var_name_<< function_args(x);
-        std::string str_dims = get_dims(x.dims_);
-        if (str_dims != "") o_<<", dims=["<<str_dims<<",";
-        else o_ <<", dims=[";
-        pyro_generate_expression_as_index(x.M_, NOT_USER_FACING, o_);
-        o_<<", ";
-        pyro_generate_expression_as_index(x.N_, NOT_USER_FACING, o_);
-        o_<<"])"<<std::endl;;
-      }
-
-      void operator()(const unit_vector_var_decl& x) const {
-        assert (false);
-      }
-
-      void operator()(const simplex_var_decl& x) const {
-        o_ <<"check_constraints(" <<var_name_;
-        std::string str_dims = get_dims(x.dims_);
-        if (str_dims != "") o_<<", dims=["<<str_dims <<"]";
-        else o_ <<", dims=[1]";
-        o_<<")"<<std::endl;
-      }
-
-      void operator()(const ordered_var_decl& x) const {
-        assert (false);
-      }
-
-      void operator()(const positive_ordered_var_decl& x) const {
-        assert (false);
-      }
-
-      void operator()(const cholesky_factor_var_decl& x) const {
-        assert (false);
-      }
-
-      void operator()(const cholesky_corr_var_decl& x) const {
-        assert (false);
-      }
-
-      void operator()(const cov_matrix_var_decl& x) const {
-        o_ <<"check_constraints(" <<var_name_; //<< function_args(x);
-        std::string str_dims = get_dims(x.dims_);
-        if (str_dims != "") o_<<", dims=["<<str_dims<<",";
-        else o_ <<", dims=[";
-        pyro_generate_expression_as_index(x.K_, NOT_USER_FACING, o_);
-        o_<<", ";
-        pyro_generate_expression_as_index(x.K_, NOT_USER_FACING, o_);
-        o_<<"])"<<std::endl;;
-      }
-
-      void operator()(const corr_matrix_var_decl& x) const {
-        assert (false);
-      }
-    };
-
-
-    void generate_var_init_python(var_decl v, int indent, std::ostream& o){
-        std::string var_name = safeguard_varname(v.name());
-        generate_indent(indent, o);
-        o << var_name << " = ";
-        stan::lang::pyro_init_visgen  iv(0,o,var_name,false);
-        boost::apply_visitor(iv, v.decl_);
-        return;
-        /*generate_indent(indent, o);
-        o << var_name << " = ";
-
-        if ( vector_var_decl* vec_v = boost::get<vector_var_decl>( &(v.decl_) ) ){
-            // source:  http://www.boost.org/doc/libs/1_55_0/doc/html/variant/tutorial.html
-            o<< "torch.zeros(";
-            std::string str_dims = get_dims(vec_v->dims_);
-            if (str_dims != "") o<<str_dims<<", ";
-            stan::lang::pyro_generate_expression_as_index(vec_v->M_, NOT_USER_FACING, o);
-
-            o<<")\n";
-            return;
+            print_usage(std::cerr);
+            return 1;
         }
-        if ( matrix_var_decl* vec_v = boost::get<matrix_var_decl>( &(v.decl_) ) ){
-            // source:  http://www.boost.org/doc/libs/1_55_0/doc/html/variant/tutorial.html
-            o<< "torch.zeros(";
-            std::string str_dims = get_dims(vec_v->dims_);
-            if (str_dims != "") o<<str_dims<<", ";
-            stan::lang::pyro_generate_expression_as_index(vec_v->M_, NOT_USER_FACING, o);
-            o <<", ";
-            stan::lang::pyro_generate_expression_as_index(vec_v->N_, NOT_USER_FACING, o);
-            o<<")\n";
-            return;
-        }
-
-
-        // TODO: for each dimension expression, output that expression
-        int n_dims = v.dims().size();
-        if (n_dims == 0) {
-            if ( int_var_decl* iv = boost::get<int_var_decl>( &(v.decl_) ) ) o<<"0\n";
-            else o<< "0.\n";
-        }
-        else o<< "torch.zeros(";
-        for(int kk=0; kk<n_dims; kk++){
-            pyro_generate_expression(v.dims()[kk], NOT_USER_FACING, o);
-            if (kk != n_dims-1) o<<",";
-            else o<<")\n";
-        }*/
     }
-
-
-    void generate_transformed_params_computation(const program &p, int indent, std::ostream& o,
-                                                 std::set<std::string> *ptr_indices){
-        int n_td = p.derived_decl_.first.size();
-        int n_td_s = p.derived_decl_.second.size();
-        // assert(n_td == n_td_s);
-        generate_indent(1, std::cout);
-        std::cout<<"# INIT transformed parameters\n";
-        for (int i=0;i < n_td; i++){
-            var_decl vd = p.derived_decl_.first[i];
-            generate_var_init_python(vd, indent, o);
-        }
-        for (int i=0;i < n_td_s; i++){
-            //o << "# t-params i=" << i <<EOL;
-            pyro_statement(p.derived_decl_.second[i], p, indent, o, ptr_indices);
-        }
+    if (model_fname.empty() == manifest_fname.empty()) {
+        print_usage(std::cerr);
+        return 1;
     }
-
-    void extract_data(const program &p, bool use_derived_data = true) {
-
-
-        generate_indent(1, std::cout);
-        std::cout<<"# INIT data\n";
-        for (int i = 0; i < p.data_decl_.size(); i++) {
-            generate_indent(1, std::cout);
-            std::string var_name = safeguard_varname(p.data_decl_[i].name());
-            std::cout << var_name <<  " = data[\"" << var_name << "\"]\n";
+    if (n_threads == 0) n_threads = 1;
+
+    stan::lang::pyro_compile_options options;
+    options.keep_ = keep;
+    options.subsample_ = subsample;
+    if (!cache_dir.empty()) {
+        try {
+            options.cache_.reset(new stan::lang::pyro_compile_cache(cache_dir, cache_max_bytes));
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
         }
+    }
 
-        int n_td = p.derived_data_decl_.first.size();
-
-        if (n_td > 0 && use_derived_data) {
-            stan::lang::generate_indent(1, std::cout);
-            std::cout<<"# INIT transformed data\n";
-            for(int j=0; j<n_td; j++){
-                std::string var_name = safeguard_varname(p.derived_data_decl_.first[j].name());
-                generate_indent(1, std::cout);
-                std::cout << var_name << " = data[\"" << var_name << "\"]\n";
+    if (!manifest_fname.empty()) {
+        std::vector<batch_job> jobs;
+        if (!read_manifest(manifest_fname, jobs, std::cerr))
+            return 1;
+        stan::lang::pyro_clock::time_point start = stan::lang::pyro_clock::now();
+        run_batch(jobs, n_threads, options);
+        double wall_ms = stan::lang::elapsed_ms(start);
+        if (summary_fname.empty()) {
+            print_batch_summary(jobs, n_threads, wall_ms, options.cache_.get(), std::cout);
+        } else {
+            std::ofstream fsummary(summary_fname.c_str());
+            print_batch_summary(jobs, n_threads, wall_ms, options.cache_.get(), fsummary);
+            if (!fsummary) {
+                std::cerr << "cannot write summary: " << summary_fname << std::endl;
+                return 1;
             }
         }
+        for (size_t i = 0; i < jobs.size(); ++i)
+            if (!jobs[i].result_.ok_) return 1;
+        return 0;
     }
 
-  }
-}
-
-
-
-
-
-
-//TODO: write a visitor struct for statement_ similar to statement_visgen.hpp in /stan/lang/generator/
-void printer(const stan::lang::program &p) {
-    std::set<std::string> indices; // to maintain for loop indices as they arrive in the AST
-
-    std::cout<<"def validate_data_def(data):"<<std::endl;
-    int n_d = p.data_decl_.size();
-    for(int j=0; j<n_d; j++){
-        stan::lang::generate_indent(1, std::cout);
-        std::string var_name = stan::lang::safeguard_varname(p.data_decl_[j].name());
-        std::cout<<"assert '"<<var_name<<"' in data, 'variable not found in data: key="<<var_name<<"'"<<std::endl;
-    }
-    stan::lang::extract_data(p, false);
-
-    std::stringstream ss_data_def; //to verify data dimensions / constraints in python
-    for(int j=0; j<n_d; j++){
-        std::string var_name = stan::lang::safeguard_varname(p.data_decl_[j].name());
-        stan::lang::generate_indent(1, ss_data_def);
-        //ss_data_def << "'"<<var_name<<"' : ";
-        stan::lang::pyro_varshape_visgen  vv(0,ss_data_def, var_name);
-        boost::apply_visitor(vv, p.data_decl_[j].decl_);
-    }
-    std::cout<<ss_data_def.str();
-
-    int n_td = p.derived_data_decl_.first.size();
-    int n_td_s = p.derived_data_decl_.second.size();
-
-    if (n_td > 0) {
-
-        std::cout << "\ndef transformed_data(data):" << "\n";
-        stan::lang::extract_data(p, false);
-        for(int j=0; j<n_td; j++){
-            std::string var_name = stan::lang::safeguard_varname(p.derived_data_decl_.first[j].name());
-            stan::lang::generate_var_init_python((p.derived_data_decl_.first[j]), 1, std::cout);
-        }
-
-        for(int j=0; j<n_td_s; j++){
-            stan::lang::pyro_statement(p.derived_data_decl_.second[j], p, 1, std::cout, &indices);
-        }
-        for(int j=0; j<n_td; j++){
-            std::string var_name = stan::lang::safeguard_varname(p.derived_data_decl_.first[j].name());
-            stan::lang::generate_indent(1, std::cout);
-            std::cout << "data[\"" << var_name << "\"] = ";
-            std::cout << var_name << "\n";
+    stan::lang::pyro_compile_result res = compile_stan_file(model_fname, options);
+    std::cout << res.python_;
+    std::cerr << res.messages_;
+    if (!res.ok_)
+        return 1;
+    if (phase_timings) {
+        if (options.cache_) {
+            std::cerr << "# cache " << (res.cache_hit_ ? "hit " : "miss ");
+            options.cache_->print_stats(std::cerr);
+            std::cerr << std::endl;
         }
-
-    }
-    std::cout << "\ndef init_params(data, params):" << "\n";
-    stan::lang::extract_data(p, true);
-
-    stan::lang::generate_indent(1, std::cout);
-    std::cout<<"# assign init values for parameters\n";
-    for (int i = 0; i < p.parameter_decl_.size(); i++) {
-        stan::lang::generate_indent(1, std::cout);
-        std::string var_name = stan::lang::safeguard_varname(p.parameter_decl_[i].name());
-        std::cout << "params[\"" << var_name << "\"] = ";
-        stan::lang::var_decl x = p.parameter_decl_[i];
-        stan::lang::pyro_init_visgen  iv(0,std::cout,var_name, false);
-        boost::apply_visitor(iv, p.parameter_decl_[i].decl_);
-    }
-    std::cout << "\ndef model(data, params):" << "\n";
-    stan::lang::extract_data(p, true);
-
-    stan::lang::generate_indent(1, std::cout);
-    std::cout<<"# INIT parameters\n";
-    for (int i = 0; i < p.parameter_decl_.size(); i++) {
-        stan::lang::generate_indent(1, std::cout);
-        std::cout << stan::lang::safeguard_varname(p.parameter_decl_[i].name()) <<  " = params[\"";
-        std::cout << stan::lang::safeguard_varname(p.parameter_decl_[i].name()) << "\"]\n";
+        res.timings_.print(std::cerr);
     }
-    stan::lang::generate_transformed_params_computation(p, 1, std::cout, &indices);
-
-    stan::lang::generate_indent(1, std::cout);
-    std::cout<<"# MODEL block"<<std::endl;
-
-    stan::lang::pyro_statement(p.statement_, p, 1, std::cout, &indices);
-}
-
-int main(int argc, char *argv[]) {
-    assert(argc == 2);
-    std::string  model_fname = argv[1];
-    //std::cout<<"model_file_name: "<<model_fname<<std::endl;
-    std::ifstream fin(model_fname.c_str());
-    std::string mname_ = "temp_model";
-    std::stringstream out;
-    stan::lang::program p;
-    bool valid_model = stan::lang::compile_ast(&std::cerr,fin,out,p,mname_);
-    //std::cout<<out.str()<<" ";
-    //std::cout<<valid_model<<std::endl;
-    printer(p);
     return 0;
 }
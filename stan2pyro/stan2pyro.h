@@ -0,0 +1,84 @@
+#ifndef STAN2PYRO_H
+#define STAN2PYRO_H
+
+/*
+ * C interface of libstan2pyro: compile Stan source held in memory to
+ * Python source, without the stan2pyro binary.
+ *
+ * Every function is safe to call concurrently, except that an options
+ * object must not be modified while a compilation uses it.  Strings
+ * returned by a result are owned by it and stay valid until it is
+ * freed.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct stan2pyro_options stan2pyro_options;
+typedef struct stan2pyro_result stan2pyro_result;
+
+/* Version of this interface; bumped on incompatible changes. */
+#define STAN2PYRO_ABI_VERSION 1
+
+int stan2pyro_abi_version(void);
+
+stan2pyro_options* stan2pyro_options_new(void);
+
+/*
+ * Set an option.  Keys:
+ *   "filename"         name of the program in messages (default "unknown file name")
+ *   "include_path"     directory searched by #include; may be set several times
+ *   "cache_dir"        compile cache directory, "" to disable (default disabled)
+ *   "cache_max_bytes"  size cap of the compile cache (default 268435456)
+ *   "keep"             transformed data, transformed parameter or model local
+ *                      to compute even if no sampling statement needs it; may
+ *                      be set several times
+ *   "subsample"        mini-batch size of the likelihood plates over the rows
+ *                      of the data, scaled to unbiased estimates; "0" to
+ *                      observe every row (default 0)
+ *
+ * Returns 0 on success, -1 for an unknown key or invalid value, which leaves
+ * the options as they were.
+ */
+int stan2pyro_options_set(stan2pyro_options* options, const char* key,
+                          const char* value);
+
+void stan2pyro_options_free(stan2pyro_options* options);
+
+/*
+ * Compile a Stan program.  options may be NULL for the defaults.  Returns
+ * NULL only when out of memory; free the result with
+ * stan2pyro_result_free.
+ */
+stan2pyro_result* stan2pyro_compile(const char* stan_source,
+                                    const stan2pyro_options* options);
+
+/* 1 if the program was compiled, 0 otherwise. */
+int stan2pyro_result_ok(const stan2pyro_result* result);
+
+/* Generated Python module; "" on failure. */
+const char* stan2pyro_result_python(const stan2pyro_result* result);
+
+/*
+ * Diagnostics as a JSON object:
+ *   {"ok": bool, "error_kind": "" | "io" | "syntax" | "unsupported" | "internal",
+ *    "messages": string, "cached": bool,
+ *    "timings": {"read_ms": .., "parse_ms": .., "analyze_ms": .., "emit_ms": .., "total_ms": ..},
+ *    "optimizations": {"folded": .., "propagated": .., "hoisted": ..,
+ *                      "shared": .., "eliminated": .., "rebased": ..,
+ *                      "accesses": .., "in_bounds": .., "enumerated": ..,
+ *                      "subsampled": .., "reduced": ..}}
+ * in_bounds of the accesses are proven within bounds and left unchecked;
+ * enumerated counts the log_sum_exp mixtures sampled as enumerated
+ * latent variables; subsampled the plates observed in mini-batches;
+ * reduced the accumulation loops computed as one torch reduction.
+ */
+const char* stan2pyro_result_diagnostics(const stan2pyro_result* result);
+
+void stan2pyro_result_free(stan2pyro_result* result);
+
+#ifdef __cplusplus
+}
+#endif
+#endif